@@ -0,0 +1,700 @@
+/*
+	Headless benchmark for the particle world.
+
+	Builds scenes like BlobDemo's (a box of four platforms, two inner
+	platforms and a lattice of blobs) at the requested sizes, steps each one
+	for a fixed number of frames as fast as possible and reports the
+	throughput.  Nothing here touches GLUT, so it runs on machines without a
+	display.
+
+	Usage:
+		bench [options] [blobs...]
+
+		-f <frames>      frames to time for each scene (default 1000)
+		-w <frames>      untimed frames stepped first (default 100)
+		-t <threads>     threads the world steps on (default 1)
+		-s <solver>      contact solver, "sequential", "batched" or "pgs"
+		-z <energy>      let islands below this energy sleep (default off)
+		-p               time the phases of each step and report them too
+		-b <broad phase> sphere broad phase, "grid" or "sweep" (default grid)
+		-r <radius>      give the blobs radii from 1 up to this, rather than
+		                 all 2 like the demo
+		-g <segments>    scatter this many short static segments in the box
+		-l               register a Platform generator per segment instead
+		                 of baking them in to one StaticSegments generator
+		-k               cache contacts between steps and warm start the
+		                 resolver from them (only the pgs solver uses them)
+		-d               step in determinism mode (contacts sorted each step)
+		-c               print a checksum of each scene's final state, to
+		                 compare runs (e.g. before and after a change)
+		-v               run each scene again on one thread and fail if its
+		                 final state differs from the timed run's, or if
+		                 a checkpoint of it loads with a different checksum
+		                 or doesn't carry on the same for 50 more frames
+		-o <prefix>      record the timed frames of each scene to
+		                 <prefix>-<blobs>.traj with a TrajectoryRecorder
+		-m               read each recording back, in order and jumping
+		                 around, and fail if any frame differs from a rerun
+		                 of the scene by more than the recording's quantum
+		-e <rate>        steps per simulated second (default 100, the demo's)
+		-x <substeps>    step with runPhysicsSubstepped, in this many
+		                 substeps, instead of runPhysics
+
+	With no sizes given it runs 25 (the demo), 500, 2000 and 8000 blobs.
+
+	Built as the bench target of the CMake build.
+*/
+#include <pworld.h>
+#include <grid.h>
+#include <platform.h>
+#include <sweep.h>
+#include <segments.h>
+#include <recorder.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// The demo steps with a 10ms timer.
+static const float defaultStepRate = 100.0f;
+
+// Frames a scene and its restored checkpoint are stepped on by -v.
+static const unsigned verifyFrames = 50;
+
+enum BroadPhase
+{
+	BROAD_GRID,
+	BROAD_SWEEP
+};
+
+struct BenchOptions
+{
+	unsigned frames;
+	unsigned warmup;
+	unsigned threads;
+	ParticleContactResolver::SolverMode solver;
+	float sleepEnergy;
+	bool phases;
+	BroadPhase broadPhase;
+	float maxRadius;
+	unsigned extraSegments;
+	bool platformGenerators;
+	const char *recordPrefix;
+	bool checkRecording;
+	bool checksum;
+	bool deterministic;
+	bool verify;
+	bool contactCaching;
+	float stepRate;
+	unsigned substeps;
+	std::vector<unsigned> sizes;
+};
+
+struct BenchResult
+{
+	double seconds;
+	unsigned long long contacts;
+	unsigned long long dropped;
+	unsigned long long awake;
+	unsigned long long iterationsUsed;
+	unsigned long long iterationBudget;
+	unsigned long long cached;
+
+	// Summed phase times, when the phases are timed.
+	double integrateTime;
+	double generateTime;
+	double resolveTime;
+	double sleepTime;
+
+	// Frames recorded and dropped, and the size of the recording, when recording.
+	unsigned recordedFrames;
+	unsigned droppedFrames;
+	long recordingBytes;
+
+	// Checksum of the state after the last frame.
+	unsigned long long checksum;
+};
+
+/*
+	A BlobDemo scene scaled to hold the given number of blobs.  The box is
+	the demo's 196 units across until the blobs need more room than that,
+	and the inner platforms scale with it.  The grid's cells are sized for
+	the largest blob.  Any extra segments are scattered over the lower half
+	of the box, where the blobs settle.
+*/
+class BenchScene
+{
+public:
+	BenchScene(unsigned numBlobs, const BenchOptions &options);
+	~BenchScene();
+
+	// Steps the scene, recording the timed frames to recordPath if it is given.
+	BenchResult run(unsigned warmup, unsigned frames, const char *recordPath);
+
+	/*
+		Steps the scene as run() does and compares it with every frame of the
+		recording at recordPath.  Returns the number of frames that differ by
+		more than their quantum, or can't be read, or ~0u if the recording
+		can't be opened.
+	*/
+	unsigned checkRecording(unsigned warmup, unsigned frames, const char *recordPath);
+
+	// Saves and loads the scene's state, and its segments, as a checkpoint.
+	bool saveCheckpoint(const char *path);
+	bool loadCheckpoint(const char *path);
+
+	unsigned long long getChecksum() const;
+
+	/*
+		Steps the scene on from where it is, after forgetting its cached
+		contacts, which a checkpoint doesn't hold.
+	*/
+	void continueWithoutCache(unsigned frames);
+
+private:
+	// Steps the world once, as the options asked.
+	void step();
+
+	// Largest blob radius, and the distance between blobs at the start.
+	static float largestRadius(const BenchOptions &options);
+	static float blobSpacing(const BenchOptions &options);
+
+	// Half the width of the box the blobs start in.
+	static float boxHalfSize(unsigned numBlobs, float spacing);
+
+	unsigned numBlobs;
+	float spacing;
+	float halfSize;
+	float frameDuration;
+	unsigned substeps;
+
+	Particle *blobs;
+	std::vector<Platform> platforms;
+	StaticSegments segments;
+	Grid grid;
+	SweepAndPrune sweep;
+	ParticleGravity gravity;
+	ParticleWorld world;
+};
+
+float BenchScene::largestRadius(const BenchOptions &options)
+{
+	return options.maxRadius > 0 ? options.maxRadius : 2.0f;
+}
+
+float BenchScene::blobSpacing(const BenchOptions &options)
+{
+	// The demo's blobs start 5 units apart.
+	return largestRadius(options) * 2.0f + 1.0f;
+}
+
+float BenchScene::boxHalfSize(unsigned numBlobs, float spacing)
+{
+	// Leave as much room again as the blobs start in, for them to move in.
+	float half = spacing * sqrtf((float)numBlobs);
+	return half > 98.0f ? half : 98.0f;
+}
+
+BenchScene::BenchScene(unsigned numBlobs, const BenchOptions &options)
+:
+numBlobs(numBlobs),
+spacing(blobSpacing(options)),
+halfSize(boxHalfSize(numBlobs, spacing)),
+frameDuration(1.0f / options.stepRate),
+substeps(options.substeps),
+blobs(0),
+grid((int)(halfSize * 2.0f) + 4, (int)(halfSize * 2.0f) + 4, (int)ceilf(largestRadius(options) * 2.0f)),
+gravity(Vector2::GRAVITY * 20.0f),
+world(numBlobs * 4 + 16, 0)
+{
+	world.setThreadCount(options.threads);
+	world.getResolver().setMode(options.solver);
+	world.setDeterministic(options.deterministic);
+	world.setContactCaching(options.contactCaching);
+	world.setStepTiming(options.phases);
+
+	blobs = world.createParticles(numBlobs);
+
+	float pos = halfSize;
+	float neg = -halfSize;
+	float scale = halfSize / 98.0f;
+
+	platforms.resize(6 + options.extraSegments);
+
+	platforms[0].start = Vector2(neg, pos);
+	platforms[0].end = Vector2(pos, pos);
+	platforms[1].start = platforms[0].end;
+	platforms[1].end = Vector2(pos, neg);
+	platforms[2].start = platforms[1].end;
+	platforms[2].end = Vector2(neg, neg);
+	platforms[3].start = platforms[2].end;
+	platforms[3].end = Vector2(neg, pos);
+
+	platforms[4].start = Vector2(-80, 30) * scale;
+	platforms[4].end = Vector2(-10, 15) * scale;
+	platforms[5].start = Vector2(80, 30) * scale;
+	platforms[5].end = Vector2(10, 15) * scale;
+
+	// Short segments at fixed pseudo-random positions and angles.
+	unsigned seed = 12345;
+	for (unsigned i = 6; i < platforms.size(); i++){
+		seed = seed * 1103515245u + 12345u;
+		float x = neg + (halfSize * 2.0f) * ((seed >> 8) % 10000) / 10000.0f;
+		seed = seed * 1103515245u + 12345u;
+		float y = neg + halfSize * ((seed >> 8) % 10000) / 10000.0f;
+		seed = seed * 1103515245u + 12345u;
+		float angle = 3.14159f * ((seed >> 8) % 10000) / 10000.0f;
+
+		Vector2 half(cosf(angle) * 2.0f, sinf(angle) * 2.0f);
+		platforms[i].start = Vector2(x, y) - half;
+		platforms[i].end = Vector2(x, y) + half;
+	}
+
+	if (options.platformGenerators){
+		for (unsigned i = 0; i < platforms.size(); i++){
+			platforms[i].particles = blobs;
+			platforms[i].numParticles = numBlobs;
+			world.getContactGenerators().push_back(&platforms[i]);
+		}
+	}
+	else {
+		segments.addPlatforms(&platforms[0], (unsigned)platforms.size());
+		segments.setParticles(&world.getParticles());
+		world.getContactGenerators().push_back(&segments);
+	}
+
+	// Fill the top of the box row by row, moving right like the demo's blobs.
+	unsigned columns = (unsigned)((halfSize * 2.0f - spacing * 2.0f) / spacing);
+	if (columns < 1) columns = 1;
+
+	for (unsigned i = 0; i < numBlobs; i++){
+		float x = neg + spacing + (i % columns) * spacing;
+		float y = pos - spacing - (i / columns) * spacing;
+
+		// Spread the radii over the range without any pattern in the lattice.
+		float radius = 2.0f;
+		if (options.maxRadius > 0) radius = 1.0f + (options.maxRadius - 1.0f) * ((i * 7919u) % 100) / 99.0f;
+
+		blobs[i].setPosition(x, y);
+		blobs[i].setVelocity(80.0f, 0.0f);
+		blobs[i].setDamping(0.8f);
+		blobs[i].setAngularDamping(0.8f);
+		blobs[i].setAngularVelocity(10.0f);
+		blobs[i].setAngularAcceleration(0.0f);
+		blobs[i].setMass(1.0f);
+		blobs[i].setRadius(radius);
+		blobs[i].setOrientation(0);
+		blobs[i].clearAccumulators();
+	}
+
+	// Gravity is a force generator over the blobs, as in the demo.
+	world.getForceRegistry().add(&gravity, blobs[0].getIndex(), numBlobs);
+
+	if (options.broadPhase == BROAD_SWEEP){
+		sweep.setParticles(&world.getParticles());
+		world.getContactGenerators().push_back(&sweep);
+	}
+	else {
+		grid.setParticles(&world.getParticles());
+		world.getContactGenerators().push_back(&grid);
+	}
+
+	if (options.sleepEnergy > 0) world.setSleeping(options.sleepEnergy, 30);
+}
+
+BenchScene::~BenchScene()
+{
+}
+
+void BenchScene::step()
+{
+	if (substeps > 0) world.runPhysicsSubstepped(frameDuration, substeps);
+	else world.runPhysics(frameDuration);
+}
+
+BenchResult BenchScene::run(unsigned warmup, unsigned frames, const char *recordPath)
+{
+	for (unsigned i = 0; i < warmup; i++){
+		step();
+	}
+
+	BenchResult result;
+	result.contacts = 0;
+	result.dropped = 0;
+	result.awake = 0;
+	result.iterationsUsed = 0;
+	result.iterationBudget = 0;
+	result.cached = 0;
+	result.integrateTime = 0;
+	result.generateTime = 0;
+	result.resolveTime = 0;
+	result.sleepTime = 0;
+	result.recordedFrames = 0;
+	result.droppedFrames = 0;
+	result.recordingBytes = 0;
+
+	TrajectoryRecorder recorder;
+	if (recordPath && !recorder.open(recordPath, world.getStore().size())){
+		fprintf(stderr, "couldn't create %s\n", recordPath);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < frames; i++){
+		step();
+		if (recorder.isOpen()) recorder.record(world.getStore(), i);
+
+		const ParticleWorld::StepStats &stats = world.getStepStats();
+		result.contacts += stats.contactsGenerated;
+		result.dropped += stats.contactsDropped;
+		result.awake += stats.awakeCount;
+		result.iterationsUsed += stats.iterationsUsed;
+		result.iterationBudget += stats.iterationBudget;
+		result.cached += stats.contactsCached;
+		result.integrateTime += stats.integrateTime;
+		result.generateTime += stats.generateTime;
+		result.resolveTime += stats.resolveTime;
+		result.sleepTime += stats.sleepTime;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	result.seconds = std::chrono::duration<double>(end - start).count();
+	result.checksum = world.getChecksum();
+
+	if (recorder.isOpen()){
+		recorder.close();
+		result.recordedFrames = recorder.getRecordedFrames();
+		result.droppedFrames = recorder.getDroppedFrames();
+
+		FILE *file = fopen(recordPath, "rb");
+		if (file){
+			fseek(file, 0, SEEK_END);
+			result.recordingBytes = ftell(file);
+			fclose(file);
+		}
+	}
+	return result;
+}
+
+// Returns true if a recorded frame is within its quanta of the store.
+static bool frameMatches(const TrajectoryFrame &frame, const TrajectoryReader &reader, const ParticleStore &store)
+{
+	const std::vector<float> *columns[TrajectoryFrame::columnCount] =
+		{ &store.positionX, &store.positionY, &store.velocityX, &store.velocityY, &store.orientation };
+
+	for (unsigned c = 0; c < TrajectoryFrame::columnCount; c++){
+		const std::vector<float> &recorded = frame.getColumn(c);
+		const std::vector<float> &actual = *columns[c];
+		if (recorded.size() != actual.size()) return false;
+
+		// Half a quantum from rounding, and a little for scaling back up.
+		float quantum = reader.getQuantum(c);
+		for (size_t i = 0; i < actual.size(); i++){
+			float tolerance = quantum * 0.5f + fabsf(actual[i]) * 1e-6f;
+			if (!(fabsf(recorded[i] - actual[i]) <= tolerance)) return false;
+		}
+	}
+	return true;
+}
+
+unsigned BenchScene::checkRecording(unsigned warmup, unsigned frames, const char *recordPath)
+{
+	// One reader goes through the frames in order, the other jumps to each
+	// from somewhere else in the recording and must decode it identically.
+	TrajectoryReader reader, jumper;
+	if (!reader.open(recordPath) || !jumper.open(recordPath)) return ~0u;
+
+	for (unsigned i = 0; i < warmup; i++){
+		step();
+	}
+
+	unsigned count = reader.getFrameCount();
+	unsigned differing = 0;
+	unsigned next = 0;
+	TrajectoryFrame frame, jumped;
+	for (unsigned i = 0; i < frames && next < count; i++){
+		step();
+
+		// Frames the recorder dropped are missing, so match them by step.
+		if (reader.getStep(next) != i) continue;
+
+		bool matches = reader.readFrame(next, frame) && frameMatches(frame, reader, world.getStore());
+		if (matches){
+			matches = jumper.readFrame((next * 7919u + count / 2) % count, jumped) &&
+				jumper.readFrame(next, jumped);
+			for (unsigned c = 0; matches && c < TrajectoryFrame::columnCount; c++){
+				matches = jumped.getColumn(c) == frame.getColumn(c);
+			}
+		}
+		if (!matches) differing++;
+		next++;
+	}
+
+	// Every recorded frame should have been reached.
+	return differing + (count - next);
+}
+
+bool BenchScene::saveCheckpoint(const char *path)
+{
+	return world.saveCheckpoint(path, &segments);
+}
+
+bool BenchScene::loadCheckpoint(const char *path)
+{
+	return world.loadCheckpoint(path, &segments);
+}
+
+unsigned long long BenchScene::getChecksum() const
+{
+	return world.getChecksum();
+}
+
+void BenchScene::continueWithoutCache(unsigned frames)
+{
+	world.setContactCaching(world.isContactCaching());
+	for (unsigned i = 0; i < frames; i++){
+		step();
+	}
+}
+
+static const char* solverName(ParticleContactResolver::SolverMode solver)
+{
+	switch (solver){
+	case ParticleContactResolver::SOLVE_BATCHED: return "batched";
+	case ParticleContactResolver::SOLVE_PGS: return "pgs";
+	default: return "sequential";
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-f frames] [-w warmup] [-t threads] [-s sequential|batched|pgs] [-z energy] [-p] [-b grid|sweep] [-r radius] [-g segments] [-l] [-k] [-d] [-c] [-v] [-o prefix] [-m] [-e rate] [-x substeps] [blobs...]\n",
+		name);
+}
+
+// Reads the value following an option, returning false if there isn't one.
+static bool optionValue(int argc, char **argv, int &i, const char *&value)
+{
+	if (i + 1 >= argc) return false;
+	value = argv[++i];
+	return true;
+}
+
+static bool parseOptions(int argc, char **argv, BenchOptions &options)
+{
+	options.frames = 1000;
+	options.warmup = 100;
+	options.threads = 1;
+	options.solver = ParticleContactResolver::SOLVE_SEQUENTIAL;
+	options.sleepEnergy = 0;
+	options.phases = false;
+	options.broadPhase = BROAD_GRID;
+	options.maxRadius = 0;
+	options.extraSegments = 0;
+	options.platformGenerators = false;
+	options.recordPrefix = 0;
+	options.checkRecording = false;
+	options.checksum = false;
+	options.deterministic = false;
+	options.verify = false;
+	options.contactCaching = false;
+	options.stepRate = defaultStepRate;
+	options.substeps = 0;
+
+	for (int i = 1; i < argc; i++){
+		const char *arg = argv[i];
+		const char *value = 0;
+
+		if (arg[0] != '-'){
+			int size = atoi(arg);
+			if (size <= 0) return false;
+			options.sizes.push_back((unsigned)size);
+			continue;
+		}
+
+		if (strcmp(arg, "-p") == 0){
+			options.phases = true;
+			continue;
+		}
+		if (strcmp(arg, "-l") == 0){
+			options.platformGenerators = true;
+			continue;
+		}
+		if (strcmp(arg, "-c") == 0){
+			options.checksum = true;
+			continue;
+		}
+		if (strcmp(arg, "-k") == 0){
+			options.contactCaching = true;
+			continue;
+		}
+		if (strcmp(arg, "-d") == 0){
+			options.deterministic = true;
+			continue;
+		}
+		if (strcmp(arg, "-v") == 0){
+			options.verify = true;
+			continue;
+		}
+		if (strcmp(arg, "-m") == 0){
+			options.checkRecording = true;
+			continue;
+		}
+
+		if (strlen(arg) != 2 || !optionValue(argc, argv, i, value)) return false;
+
+		switch (arg[1]){
+		case 'f': options.frames = (unsigned)atoi(value); break;
+		case 'w': options.warmup = (unsigned)atoi(value); break;
+		case 't': options.threads = (unsigned)atoi(value); break;
+		case 'g': options.extraSegments = (unsigned)atoi(value); break;
+		case 'z': options.sleepEnergy = (float)atof(value); break;
+		case 'o': options.recordPrefix = value; break;
+		case 'x': options.substeps = (unsigned)atoi(value); break;
+		case 'e':
+			options.stepRate = (float)atof(value);
+			if (options.stepRate <= 0) return false;
+			break;
+		case 'r':
+			options.maxRadius = (float)atof(value);
+			if (options.maxRadius < 1.0f) return false;
+			break;
+		case 'b':
+			if (strcmp(value, "grid") == 0) options.broadPhase = BROAD_GRID;
+			else if (strcmp(value, "sweep") == 0) options.broadPhase = BROAD_SWEEP;
+			else return false;
+			break;
+		case 's':
+			if (strcmp(value, "sequential") == 0) options.solver = ParticleContactResolver::SOLVE_SEQUENTIAL;
+			else if (strcmp(value, "batched") == 0) options.solver = ParticleContactResolver::SOLVE_BATCHED;
+			else if (strcmp(value, "pgs") == 0) options.solver = ParticleContactResolver::SOLVE_PGS;
+			else return false;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	if (options.frames < 1) return false;
+	if (options.checkRecording && !options.recordPrefix) return false;
+
+	if (options.sizes.empty()){
+		options.sizes.push_back(25);
+		options.sizes.push_back(500);
+		options.sizes.push_back(2000);
+		options.sizes.push_back(8000);
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions options;
+	if (!parseOptions(argc, argv, options)){
+		usage(argv[0]);
+		return 1;
+	}
+
+	char solver[64];
+	if (options.substeps > 0) snprintf(solver, sizeof(solver), "xpbd (%u substeps)", options.substeps);
+	else snprintf(solver, sizeof(solver), "%s", solverName(options.solver));
+
+	printf("frames %u at %g Hz, warmup %u, threads %u, solver %s, sleeping %s, broad phase %s, segments %u%s%s\n",
+		options.frames, options.stepRate, options.warmup, options.threads,
+		solver,
+		options.sleepEnergy > 0 ? "on" : "off",
+		options.broadPhase == BROAD_SWEEP ? "sweep" : "grid",
+		6 + options.extraSegments,
+		options.platformGenerators ? " (one generator each)" : "",
+		options.deterministic ? ", deterministic" : "");
+
+	bool failed = false;
+	printf("%8s %12s %14s %14s %12s %10s\n",
+		"blobs", "steps/sec", "ns/particle", "contacts/step", "dropped", "awake");
+
+	for (std::vector<unsigned>::const_iterator s = options.sizes.begin(); s != options.sizes.end(); s++){
+		BenchScene scene(*s, options);
+		char recordPath[1024];
+		if (options.recordPrefix) snprintf(recordPath, sizeof(recordPath), "%s-%u.traj", options.recordPrefix, *s);
+
+		BenchResult result = scene.run(options.warmup, options.frames, options.recordPrefix ? recordPath : 0);
+
+		double steps = (double)options.frames;
+		printf("%8u %12.1f %14.1f %14.1f %12.1f %10.1f\n",
+			*s,
+			steps / result.seconds,
+			result.seconds * 1e9 / (steps * *s),
+			result.contacts / steps,
+			result.dropped / steps,
+			result.awake / steps);
+
+		if (options.phases){
+			printf("%8s integrate %.3f ms, generate %.3f ms, resolve %.3f ms, sleep %.3f ms, iterations %.1f of %.1f\n",
+				"",
+				result.integrateTime * 1e3 / steps,
+				result.generateTime * 1e3 / steps,
+				result.resolveTime * 1e3 / steps,
+				result.sleepTime * 1e3 / steps,
+				result.iterationsUsed / steps,
+				result.iterationBudget / steps);
+			if (options.contactCaching) printf("%8s warm started %.1f contacts/step\n", "", result.cached / steps);
+		}
+
+		if (options.checksum){
+			printf("%8s checksum %016llx\n", "", result.checksum);
+		}
+
+		if (options.verify){
+			BenchOptions serial = options;
+			serial.threads = 1;
+			BenchScene reference(*s, serial);
+			BenchResult expected = reference.run(options.warmup, options.frames, 0);
+
+			bool matches = expected.checksum == result.checksum;
+			printf("%8s %s the single threaded run (%016llx)\n", "", matches ? "matches" : "DIFFERS from", expected.checksum);
+			if (!matches) failed = true;
+
+			// A checkpoint loaded over a freshly built scene should give back the same state.
+			char checkpointPath[64];
+			snprintf(checkpointPath, sizeof(checkpointPath), "bench-verify-%u.ckpt", *s);
+			BenchScene restored(*s, options);
+			bool loaded = scene.saveCheckpoint(checkpointPath) && restored.loadCheckpoint(checkpointPath);
+			remove(checkpointPath);
+
+			bool restores = loaded && restored.getChecksum() == result.checksum;
+			if (!loaded) printf("%8s checkpoint FAILED to save or load\n", "");
+			else printf("%8s checkpoint %s (%016llx)\n", "", restores ? "restores the same state" : "restores a DIFFERENT state", restored.getChecksum());
+			if (!restores) failed = true;
+
+			// And both should carry on the same way.
+			if (restores){
+				scene.continueWithoutCache(verifyFrames);
+				restored.continueWithoutCache(verifyFrames);
+				bool continues = restored.getChecksum() == scene.getChecksum();
+				printf("%8s %u frames on it %s (%016llx)\n", "", verifyFrames, continues ? "still matches" : "DIFFERS", restored.getChecksum());
+				if (!continues) failed = true;
+			}
+		}
+
+		if (options.recordPrefix){
+			printf("%8s recorded %u frames, dropped %u, %.1f bytes/particle/frame\n",
+				"",
+				result.recordedFrames,
+				result.droppedFrames,
+				result.recordedFrames ? (double)result.recordingBytes / ((double)result.recordedFrames * *s) : 0.0);
+		}
+
+		if (options.checkRecording){
+			BenchScene replay(*s, options);
+			unsigned differing = replay.checkRecording(options.warmup, options.frames, recordPath);
+			if (differing == ~0u) printf("%8s recording FAILED to open\n", "");
+			else if (differing) printf("%8s recording read back, %u of %u frames DIFFER\n", "", differing, result.recordedFrames);
+			else printf("%8s recording read back, all %u frames match\n", "", result.recordedFrames);
+			if (differing != 0) failed = true;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
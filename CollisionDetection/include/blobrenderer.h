@@ -0,0 +1,75 @@
+/*
+ * Interface file for the batched blob renderer used by the demo.
+ *
+ */
+#ifndef BLOBRENDERER_H
+#define BLOBRENDERER_H
+
+#include <vector>
+#include "snapshot.h"
+
+/*
+	Draws every particle of a snapshot as a flat disc with a line showing its
+	orientation, in two draw calls rather than several per blob.
+
+	Each frame the discs of the visible particles are written as triangles in
+	to one vertex array, and their orientation lines in to another, which are
+	then drawn with glDrawArrays.  Vertex arrays are part of OpenGL 1.1, so this
+	needs nothing beyond what the demo already uses.
+
+	Particles outside the view are skipped, and the number of segments in each
+	disc depends on how many pixels across it is, so small or distant blobs
+	don't cost as much as large ones.
+*/
+class BlobRenderer
+{
+public:
+	BlobRenderer();
+
+	/*
+		Sets the area of the world in view, and the width of the window in
+		pixels, used to cull particles and pick the detail of each disc.
+	*/
+	void setView(float left, float right, float bottom, float top, int pixelWidth);
+
+	/*
+		Draws the particles in the snapshot, coloured red, green and blue in
+		turn, at the given fraction of the way from their previous to their
+		current state.
+	*/
+	void draw(const ParticleSnapshot &snapshot, float alpha = 1.0f);
+
+	// Number of particles drawn and culled by the last draw.
+	unsigned getDrawnCount() const;
+	unsigned getCulledCount() const;
+
+private:
+	// Levels of detail, from 6 up to 6 << (levels - 1) segments per disc.
+	enum { levels = 4 };
+
+	// Picks the level of detail for a disc of the given radius.
+	unsigned getLevel(float radius) const;
+
+	// Adds a disc to the triangle arrays.
+	void addDisc(float x, float y, float radius, unsigned level, const unsigned char *colour);
+
+	float left;
+	float right;
+	float bottom;
+	float top;
+	float pixelsPerUnit;
+
+	// Unit circle points for each level, as x, y pairs.
+	std::vector<float> circles[levels];
+
+	// Triangles of the discs (x, y per vertex, r, g, b per vertex), and the
+	// orientation lines.
+	std::vector<float> discVertices;
+	std::vector<unsigned char> discColours;
+	std::vector<float> lineVertices;
+
+	unsigned drawnCount;
+	unsigned culledCount;
+};
+
+#endif // BLOBRENDERER_H
@@ -0,0 +1,143 @@
+/*
+ * Interface file for the binary checkpoint format of a particle world.
+ *
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "pstore.h"
+
+/*
+	A checkpoint is a header followed by the particle columns and the static
+	segments, each starting on a 64 byte boundary at an offset given in the
+	header.  Everything is stored exactly as it is in memory (little endian,
+	IEEE floats), so reading one is mapping the file and turning offsets in to
+	pointers: nothing is parsed, and columns can be copied in to a store in
+	one block each.
+
+	The version is bumped whenever the layout changes; older versions are
+	rejected rather than guessed at.
+*/
+enum
+{
+	CHECKPOINT_VERSION = 3,
+
+	// Columns of the particle store, in order: the float columns listed in
+	// checkpointFloatColumns, then awake (one byte each), then the frames each
+	// particle has been at rest and the sleeping island it is in (32 bits
+	// each).
+	CHECKPOINT_FLOAT_COLUMNS = 18,
+	CHECKPOINT_AWAKE_COLUMN = CHECKPOINT_FLOAT_COLUMNS,
+	CHECKPOINT_REST_COLUMN,
+	CHECKPOINT_ISLAND_COLUMN,
+	CHECKPOINT_COLUMNS,
+
+	CHECKPOINT_ALIGNMENT = 64
+};
+
+// The float columns of the store, in the order they are written.
+extern std::vector<float> ParticleStore::* const checkpointFloatColumns[CHECKPOINT_FLOAT_COLUMNS];
+
+struct CheckpointHeader
+{
+	// "PWORLDCK"
+	char magic[8];
+	uint32_t version;
+
+	// 0x01020304 as written, to catch files from a machine of the other endianness.
+	uint32_t byteOrder;
+
+	uint32_t headerSize;
+	uint32_t particleCount;
+	uint32_t segmentCount;
+
+	// Resolver settings.
+	uint32_t solverMode;
+	uint32_t iterations;
+	uint32_t calculateIterations;
+
+	// Sweeps, tolerances and largest correction of the PGS mode.
+	uint32_t velocitySweeps;
+	uint32_t positionSweeps;
+	float velocityTolerance;
+	float positionTolerance;
+	float maxCorrection;
+
+	// Compliance of the contacts when substepping.
+	float compliance;
+
+	// World settings.
+	uint32_t contactLimit;
+	uint32_t sleepFrames;
+	float sleepEnergy;
+	uint32_t integrationPath;
+	uint32_t contactCaching;
+
+	uint64_t fileSize;
+	uint64_t columnOffset[CHECKPOINT_COLUMNS];
+	uint64_t segmentOffset;
+};
+
+// A static segment as stored in a checkpoint.
+struct CheckpointSegment
+{
+	float startX;
+	float startY;
+	float endX;
+	float endY;
+	float restitution;
+};
+
+/*
+	A read-only view of a checkpoint file mapped in to memory.  The pointers
+	it hands out point straight in to the mapping, and stay valid until the
+	view is closed or destroyed.
+*/
+class CheckpointView
+{
+public:
+	CheckpointView();
+	~CheckpointView();
+
+	/*
+		Maps the given file and checks its header and layout.  Returns false,
+		leaving the view closed, if the file can't be read or isn't a valid
+		checkpoint of this version.
+	*/
+	bool open(const char *path);
+	void close();
+
+	bool isOpen() const;
+
+	const CheckpointHeader& getHeader() const;
+
+	// Returns a float column, in checkpointFloatColumns order.
+	const float* getFloatColumn(unsigned column) const;
+
+	const unsigned char* getAwake() const;
+	const uint32_t* getRestFrames() const;
+	const uint32_t* getIslands() const;
+	const CheckpointSegment* getSegments() const;
+
+private:
+	// Checks the header and its settings, that every column lies inside the
+	// file and that every island is a particle's row.
+	bool validate() const;
+
+	// The mapped file.  The file handles are closed as soon as it is mapped.
+	const unsigned char *data;
+	size_t size;
+};
+
+/*
+	Rounds an offset up to the alignment of the sections of a checkpoint.
+*/
+inline uint64_t alignCheckpointOffset(uint64_t offset)
+{
+	return (offset + CHECKPOINT_ALIGNMENT - 1) & ~(uint64_t)(CHECKPOINT_ALIGNMENT - 1);
+}
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,95 @@
+/*
+ * Interface file for the cache carrying contact impulses between steps.
+ *
+ */
+#ifndef CONTACTCACHE_H
+#define CONTACTCACHE_H
+
+#include <vector>
+#include "pcontacts.h"
+
+/*
+	Remembers the impulse each contact applied, from one step to the next, so
+	the resolver can warm start from it.
+
+	Contacts are keyed by the rows of their two particles (either way round),
+	or for contacts with the scenery by the particle's row and the generator
+	that reported it.  A particle touching two pieces of scenery from the
+	same generator gives two contacts with the same key, told apart by the
+	order they were reported in.
+
+	The cache is a pair of open addressing hash tables, one holding last
+	step's contacts and one this step's, swapped each step, so a contact that
+	wasn't reported this step is forgotten without having to be removed.
+
+	Each step: fetch() the contacts before resolving them, which sets each
+	one's accumulatedImpulse to the impulse it applied last step, and store()
+	them afterwards.  The contacts mustn't be reordered in between.
+*/
+class ContactCache
+{
+public:
+	ContactCache();
+
+	/*
+		Sets the accumulated impulse of each contact from the cache, scaled
+		down by how far its normal has turned since last step (and 0 for new
+		contacts), and adds the contacts to this step's table.
+	*/
+	void fetch(ParticleContact *contacts, unsigned count);
+
+	/*
+		Records the impulse each contact ended the step with, ready for the
+		next step.  Must follow fetch() with the same contacts.
+	*/
+	void store(const ParticleContact *contacts, unsigned count);
+
+	// Forgets every contact.
+	void clear();
+
+	// Number of contacts fetched in the last step, and how many of them were found.
+	unsigned getFetched() const;
+	unsigned getHits() const;
+
+private:
+	struct Entry
+	{
+		// Row of the lower particle, row + 1 of the higher or 0 for
+		// scenery, and the generator and ordinal for scenery.
+		unsigned first;
+		unsigned second;
+		unsigned tag;
+
+		// Impulse applied and the normal it was applied along.
+		float impulse;
+		Vector2 normal;
+
+		bool used;
+	};
+
+	struct Table
+	{
+		std::vector<Entry> entries;
+		unsigned mask;
+
+		// Returns the slot holding the key, or the empty slot it would go in.
+		unsigned find(unsigned first, unsigned second, unsigned tag) const;
+	};
+
+	static Entry emptyEntry();
+
+	// Sets the key of an entry for a contact, returning its normal turned to
+	// point the way the key's order of particles has it.
+	static Vector2 makeKey(const ParticleContact &contact, Entry &entry);
+
+	Table previous;
+	Table current;
+
+	// Slot in the current table of each fetched contact.
+	std::vector<unsigned> contactSlot;
+
+	unsigned fetched;
+	unsigned hits;
+};
+
+#endif // CONTACTCACHE_H
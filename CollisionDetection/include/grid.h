@@ -1,22 +1,110 @@
+/*
+ * Interface file for the uniform grid broad phase.
+ *
+ */
+#ifndef GRID_H
+#define GRID_H
+
 #include <vector>
 #include "coreMath.h"
 #include "particle.h"
+#include "pcontacts.h"
 
 struct Cell {
 	// Vector stores all particles contained in this cell
 	std::vector<Particle*> occupants;
 };
 
-class Grid {
+/*
+	A uniform grid of square cells covering the environment, used as a single
+	sphere-sphere contact generator for every particle in the world.
+
+	Each time contacts are requested the particles are binned in to the cell
+	containing their centre, and each particle is then only tested against the
+	particles in its own cell and the neighbouring cells.  This keeps the cost of
+	finding sphere contacts roughly linear in the number of particles, as opposed
+	to testing every particle against every other particle.
+
+	The cell size must be at least the diameter of the largest particle, otherwise
+	touching particles may be more than one cell apart and their contact missed.
+	Particles outside of the grid are clamped to the border cells, so they are still
+	tested, just less efficiently.
+*/
+class Grid : public ParticleContactGenerator {
 private:
-	std::vector<Cell> cells;
+	// Cells are rebuilt every time contacts are generated, hence mutable.
+	mutable std::vector<Cell> cells;
+
+	// Indices of the cells that have occupants this frame, so only those
+	// cells are visited and cleared.
+	mutable std::vector<unsigned> occupiedCells;
+
+	// Number of cells along the x and y axes.
+	int columns;
+	int rows;
+
+	float cellSize;
+	float inverseCellSize;
+
+	// World position of the bottom left corner of the grid.
+	Vector2 origin;
+
+	// The particles binned by this grid.
+	const std::vector<Particle*> *particles;
+
+	// Restitution given to generated contacts.
+	float restitution;
+
+	// Bins all particles in to their cells, and sorts the occupied cells so
+	// each row's cells are together and in order.
+	void binParticles() const;
+
+	// Fills the contact array with the contacts of the occupied cells in
+	// [first, last), tested against their own cell and half their neighbours.
+	unsigned addCellContacts(unsigned first, unsigned last, ParticleContact *contact, unsigned limit) const;
+
+	// Returns the column / row index for the given co-ordinate, clamped to the grid.
+	int getColumn(float x) const;
+	int getRow(float y) const;
 
 public:
+	/*
+		Creates a grid of (width / cellSize) by (height / cellSize) cells, centred
+		on the origin of the world.  cellSize must be at least 1, and at least
+		the diameter of the largest blob, since only neighbouring cells are
+		checked for contacts.
+	*/
 	Grid(int width, int height, int cellSize);
 	~Grid();
 
+	/*
+		Sets the particles this grid generates contacts for.  The grid holds on to
+		the pointer, so particles added to the list later are picked up automatically.
+	*/
+	void setParticles(const std::vector<Particle*> *particles);
+
+	// Sets the restitution given to generated contacts.
+	void setRestitution(float restitution);
+
 	// Retrieve the cell corresponding to given co-ordinates
 	Cell* getCell(float x, float y);
 
+	/*
+		Bins the particles and fills the given contact array with sphere-sphere
+		contacts between particles in the same or neighbouring cells.
+	*/
+	virtual unsigned addContact(ParticleContact *contact,
+		unsigned limit) const;
+
+	/*
+		The grid splits in to one part per row of cells, so the world can
+		generate its contacts over several threads.  prepareParts bins the
+		particles, and each part then only reads the grid.
+	*/
+	virtual unsigned getPartCount() const;
+	virtual void prepareParts() const;
+	virtual unsigned addPartContact(ParticleContact *contact,
+		unsigned limit, unsigned part) const;
+};
 
-};
\ No newline at end of file
+#endif // GRID_H
@@ -0,0 +1,48 @@
+/*
+ * Interface file for the sphere-sphere narrow phase shared by the broad phases.
+ *
+ */
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "coreMath.h"
+#include "particle.h"
+#include "pcontacts.h"
+
+/*
+	Tests a pair of particles for interpenetration, filling the given contact
+	structure if they are touching.  Returns true if the contact was used.
+
+	Pairs where both particles are asleep are skipped, since neither can have
+	moved in to the other.
+*/
+inline bool sphereContact(Particle *first, Particle *second, float restitution, ParticleContact *contact)
+{
+	if (!first->isAwake() && !second->isAwake()) return false;
+
+	Vector2 position = first->getPosition();
+	Vector2 candidatePos = second->getPosition();
+
+	// Vector between the two centres.
+	Vector2 dist = position - candidatePos;
+	float sumRadii = first->getRadius() + second->getRadius();
+
+	// Compare squared distances to avoid a square root for pairs that aren't touching.
+	if (dist.squareMagnitude() > sumRadii * sumRadii) return false;
+
+	float size = dist.magnitude();
+
+	// Particles sitting exactly on top of each other have no meaningful normal,
+	// so push them apart vertically.
+	Vector2 normal = (size > 0) ? dist * (((float)1.0) / size) : Vector2(0, 1);
+
+	contact->contactNormal = normal;
+	contact->restitution = restitution;
+	contact->particle[0] = first;
+	contact->particle[1] = second;
+	contact->penetration = sumRadii - size;
+	contact->contactPoint = candidatePos + dist * (float)0.5;
+	return true;
+}
+
+#endif // NARROWPHASE_H
@@ -2,60 +2,55 @@
      * A particle is the simplest object that can be simulated in the
      * physics system.
 	 *
+	 * The state of a particle lives in a row of a ParticleStore, and this
+	 * class is a handle to that row.  Handles are created by the
+	 * ParticleWorld that owns the store (see ParticleWorld::createParticles),
+	 * and a default constructed handle is not bound to anything.
      **/
 
 #ifndef PARTICLE_H
 #define PARTICLE_H
 
 #include "coreMath.h"
+#include "pstore.h"
 
     class Particle
     {
     protected:
-	
-	// Storing the inverse mass as opposed to mass is a convenient way of simulating
-	// objects of infinite mass (set inverse mas to 0), as well as preventing the simulation of
-	// objects of 0 mass (which would have an infinite inverse mass).
-	float inverseMass;
-	// Damping applied to linear motion.
-	float damping;
-	// Damping applied to angular motion.
-	float angularDamping;
-	float radius;
-
-	// Position of the particle in world space
-    Vector2 position;
-	// Velocity of the particle with respect to the x and y axes.
-	Vector2 velocity;
-	// Acceleration of the particle with respect to axes.
-	Vector2 acceleration;
-
-	float angularAcceleration;
-	// Angular velocity determines the rate of change of orientation.
-	float angularVelocity;
-
-
-	// Orientation of the object (which way it's facing) in radians.
-	// Where 0 orients the object directly up the y axis.
-	// positive orientation suggests clockwise rotation, and negative suggests
-	// counter-clockwise rotation.
-	float orientation;
-
-	// Force accumulator vector
-	Vector2 forceAccum;
+
+	// The store holding this particle's state.
+	ParticleStore *store;
+	// The row of this particle within the store.
+	unsigned index;
 
 	/*
-		Torque accumulator vector
+		The following values are held in the store, one column each:
+
+		inverseMass: Storing the inverse mass as opposed to mass is a convenient way of simulating
+		objects of infinite mass (set inverse mas to 0), as well as preventing the simulation of
+		objects of 0 mass (which would have an infinite inverse mass).
+
+		damping / angularDamping: Damping applied to linear / angular motion.
 
-		Torque can be thought of as the rotational equivalent to force,
-		which impacts the change in angular velocity.
+		orientation: Which way the object is facing in radians, where 0 orients the object
+		directly up the y axis. Positive orientation suggests clockwise rotation, and
+		negative suggests counter-clockwise rotation.
 
-		Like the force accumulator, the cumulative torque is only applied
-		to the next iteraction
+		forceAccum / torqueAccum: Accumulated force and torque. Torque can be thought of as the
+		rotational equivalent to force, which impacts the change in angular velocity. Like the
+		force accumulator, the cumulative torque is only applied to the next iteraction.
 	*/
-	float torqueAccum;
-    
+
 	public:
+		Particle();
+
+		/*
+			Points this handle at the given row of the given store.
+		*/
+		void bind(ParticleStore *store, unsigned index);
+		ParticleStore* getStore() const;
+		unsigned getIndex() const;
+
 		void integrate(float duration);
 		void setMass(const float mass);
 		float getMass() const;
@@ -90,12 +85,23 @@
 		void setAcceleration(const float x, const float y);
 		Vector2 getAcceleration() const;
 
+		// Returns the acceleration the particle was last integrated with,
+		// including that from the forces acting on it.
+		Vector2 getLastAcceleration() const;
+
 		void setAngularAcceleration(const float &acceleration);
 		float getAngularAcceleration() const;
 
 		void setOrientation(const float &orientation);
 		float getOrientation() const;
 
+		/*
+			Sleeping particles aren't integrated, and the world skips contacts
+			between them, until something awake touches them.
+		*/
+		void setAwake(const bool awake);
+		bool isAwake() const;
+
 		void clearAccumulators();
 		/*
 			Add force to be applied to next iteration only.
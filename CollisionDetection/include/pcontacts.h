@@ -6,7 +6,9 @@
 #ifndef PCONTACTS_H
 #define PCONTACTS_H
 
+#include <vector>
 #include "particle.h"
+#include "threadpool.h"
 
 	// Forward declaration for use as friend class
     class ParticleContactResolver;
@@ -57,6 +59,21 @@
          */
         float penetration;
 
+        /**
+         * Holds the total impulse applied along the normal at this
+         * contact while it was resolved. Generators don't set this: the
+         * resolver zeroes it, or when warm starting in the PGS mode reads
+         * the impulse to start from out of it (see ParticleContactResolver).
+         */
+        float accumulatedImpulse;
+
+        /**
+         * Holds the index, in the world's list, of the generator that
+         * reported this contact. Set by the world, for the contact cache
+         * to tell apart contacts with different pieces of scenery.
+         */
+        unsigned generator;
+
 
     protected:
         /**
@@ -70,6 +87,24 @@
         float calculateSeparatingVelocity() const;
 
     private:
+        /**
+         * Calculates the separating velocity this contact should be left
+         * with, given its separating velocity before it is resolved.
+         */
+        float calculateTargetVelocity(float separatingVelocity, float duration) const;
+
+        /**
+         * Calculates the impulse resolving the velocity of this contact
+         * applies, given its separating velocity. Returns false if both
+         * particles have infinite mass, so no impulse can be applied.
+         */
+        bool calculateImpulse(float separatingVelocity, float duration, float &impulse) const;
+
+        /**
+         * Applies an impulse along the contact normal to the particles.
+         */
+        void applyImpulse(float impulse);
+
         /**
          * Handles the impulse (change of momentum) calculations for this collision.
          */
@@ -95,18 +130,234 @@
      */
     class ParticleContactResolver
     {
+    public:
+        /**
+         * The ways the resolver can work through the contacts.
+         */
+        enum SolverMode
+        {
+            /**
+             * Resolve one contact at a time, always the one with the
+             * lowest separating velocity.
+             */
+            SOLVE_SEQUENTIAL,
+
+            /**
+             * Colour the contacts so no two contacts of the same colour
+             * share a particle, then sweep the colours, resolving all the
+             * closing contacts of a colour in parallel. The order within a
+             * colour doesn't matter, so results don't depend on the number
+             * of threads.
+             */
+            SOLVE_BATCHED,
+
+            /**
+             * Projected Gauss-Seidel: sweep every contact in order a fixed
+             * number of times, each time applying the impulse that brings
+             * it to its target separating velocity, while keeping the total
+             * impulse applied at each contact pushing the particles apart
+             * (so a later sweep can take back some of an earlier one's).
+             * Then sweep the penetrations the same way. Each sweep stops
+             * early once it changes nothing by more than the tolerance.
+             * Converges much faster than resolving the worst contact at a
+             * time on stacks, where every contact pushes on the next.
+             */
+            SOLVE_PGS
+        };
+
     protected:
         /**
          * Holds the number of iterations allowed.
          */
         unsigned iterations;
 
+        /**
+         * Holds the way contacts are resolved.
+         */
+        SolverMode mode;
+
+        /**
+         * True if contacts start from the impulse they hold.
+         */
+        bool warmStarting;
+
         /**
          * This is a performance tracking value - we keep a record
          * of the actual number of iterations used.
          */
         unsigned iterationsUsed;
 
+        /**
+         * Number of iterations the last call to resolveContacts was
+         * allowed.
+         */
+        unsigned iterationBudget;
+
+        /**
+         * Sweeps over the contacts allowed in the PGS mode, for
+         * velocities and for penetrations, the largest change in
+         * separating velocity at which a sweep counts as converged, and
+         * the penetration left at each contact.
+         */
+        unsigned velocitySweeps;
+        unsigned positionSweeps;
+        float velocityTolerance;
+        float positionTolerance;
+
+        /**
+         * The furthest the PGS position sweeps move a contact's
+         * particles apart in one sweep.
+         */
+        float maxCorrection;
+
+        /**
+         * Per contact values for the PGS mode, one entry per contact in
+         * contact order: the rows of its particles (the second ~0u for
+         * scenery), its normal, the reciprocal of its particles' summed
+         * inverse masses, the separating velocity it should end with,
+         * the impulse accumulated so far and the starting penetration.
+         */
+        std::vector<unsigned> constraintFirst;
+        std::vector<unsigned> constraintSecond;
+        std::vector<float> constraintNormalX;
+        std::vector<float> constraintNormalY;
+        std::vector<float> constraintMass;
+        std::vector<float> constraintTarget;
+        std::vector<float> constraintImpulse;
+        std::vector<float> constraintPenetration;
+
+        /**
+         * How far each particle has been moved by the PGS position
+         * sweeps, indexed by row.
+         */
+        std::vector<float> moveX;
+        std::vector<float> moveY;
+
+        /**
+         * Per contact values for substepping, alongside the rows and
+         * normals above: the penetration the contact would have with both
+         * its particles at the origin (so its penetration at any positions
+         * is this less how far apart they are along its normal), its
+         * restitution, and its separating velocity as the last substep
+         * left it.
+         */
+        std::vector<float> constraintOffset;
+        std::vector<float> constraintRestitution;
+        std::vector<float> constraintVelocity;
+
+        /**
+         * Whether each contact was pushed on in the current substep.
+         */
+        std::vector<unsigned char> constraintActive;
+
+        /**
+         * Compliance of the contacts when substepping: 0 for rigid.
+         */
+        float compliance;
+
+        /**
+         * The contacts touching each particle, indexed by the particle's
+         * row in its store: the contacts of particle p are
+         * particleContacts[particleContactStart[p]] up to
+         * particleContacts[particleContactStart[p + 1]].
+         */
+        std::vector<unsigned> particleContactStart;
+        std::vector<unsigned> particleContacts;
+
+        /**
+         * Binary min-heap of the contacts worth resolving, ordered by
+         * separating velocity and then by index, so the top is the contact
+         * a full scan of the array would pick.
+         */
+        std::vector<unsigned> heap;
+
+        /**
+         * Position of each contact in the heap, or notInHeap.
+         */
+        std::vector<unsigned> heapPosition;
+
+        /**
+         * Separating velocity of each contact when it was last updated.
+         */
+        std::vector<float> separatingVelocity;
+
+        enum { notInHeap = ~0u };
+
+        /**
+         * Builds the per-particle contact lists for the given contacts.
+         */
+        void buildContactIndex(const ParticleContact *contactArray, unsigned numContacts);
+
+        /**
+         * Recalculates the separating velocity of a contact and adds,
+         * moves or removes it in the heap accordingly.
+         */
+        void updateContact(const ParticleContact *contactArray, unsigned index);
+
+        /**
+         * Updates every contact sharing a particle with the given one.
+         */
+        void updateNeighbours(const ParticleContact *contactArray, unsigned index);
+
+        /**
+         * Heap helpers. heapLess orders two contacts by separating
+         * velocity, then by index.
+         */
+        bool heapLess(unsigned a, unsigned b) const;
+        void heapSwap(unsigned i, unsigned j);
+        void heapUp(unsigned i);
+        void heapDown(unsigned i);
+        void heapRemove(unsigned i);
+
+        /**
+         * The colour batches for the batched solver: the contacts of
+         * colour c are batchContacts[batchStart[c]] up to
+         * batchContacts[batchStart[c + 1]].
+         */
+        std::vector<unsigned> batchStart;
+        std::vector<unsigned> batchContacts;
+
+        /**
+         * Colour of each contact, and the colours already used by the
+         * contacts of each particle (one bit per colour).
+         */
+        std::vector<unsigned> contactColour;
+        std::vector<unsigned long long> particleColours;
+
+        /**
+         * Number of colours available. Contacts that can't be given one
+         * of these go in a last batch which is resolved on one thread.
+         */
+        enum { maxColours = 64 };
+
+        /**
+         * Splits the contacts in to batches of contacts that don't share
+         * a particle.
+         */
+        void colourContacts(const ParticleContact *contactArray, unsigned numContacts);
+
+        /**
+         * Resolves contacts one at a time, lowest separating velocity first.
+         */
+        void resolveContactsSequential(ParticleContact *contactArray,
+            unsigned numContacts,
+            float duration);
+
+        /**
+         * Resolves contacts by projected Gauss-Seidel sweeps.
+         */
+        void resolveContactsPGS(ParticleContact *contactArray,
+            unsigned numContacts,
+            float duration);
+
+        /**
+         * Resolves contacts a colour batch at a time across the pool.
+         */
+        void resolveContactsBatched(ParticleContact *contactArray,
+            unsigned numContacts,
+            float duration,
+            ThreadPool *pool);
+
     public:
         /**
          * Creates a new contact resolver.
@@ -118,6 +369,95 @@
          */
         void setIterations(unsigned iterations);
 
+        /**
+         * Returns the number of iterations that can be used.
+         */
+        unsigned getIterations() const;
+
+        /**
+         * Returns the number of iterations used by the last call to
+         * resolveContacts.
+         */
+        unsigned getIterationsUsed() const;
+
+        /**
+         * Returns the number of iterations the last call to
+         * resolveContacts was allowed: the iteration count, or in the PGS
+         * mode the contacts resolved by every sweep allowed.
+         */
+        unsigned getIterationBudget() const;
+
+        /**
+         * Sets the number of sweeps over the contacts in the PGS mode,
+         * for velocities and for penetrations. The iteration count is
+         * only used by the other modes.
+         */
+        void setSweeps(unsigned velocitySweeps, unsigned positionSweeps);
+
+        /**
+         * Sets when the PGS mode stops sweeping early: once a velocity
+         * sweep changes no separating velocity by more than the first
+         * tolerance, and once no contact is left penetrating by more than
+         * the second. Penetration up to the second tolerance is left
+         * alone, so resting contacts are still touching next step rather
+         * than flickering in and out of contact.
+         */
+        void setTolerance(float velocityTolerance, float positionTolerance);
+
+        /**
+         * Sets the furthest a position sweep in the PGS mode moves a
+         * contact's particles apart. Deep penetrations then take a few
+         * sweeps (or steps) to push out, rather than one large push that
+         * can shove a particle through scenery it isn't yet touching.
+         */
+        void setMaxCorrection(float maxCorrection);
+
+        /**
+         * Returns the PGS mode's sweeps, for velocities and for
+         * penetrations.
+         */
+        unsigned getVelocitySweeps() const;
+        unsigned getPositionSweeps() const;
+
+        /**
+         * Returns the PGS mode's velocity and position tolerances.
+         */
+        float getVelocityTolerance() const;
+        float getPositionTolerance() const;
+
+        /**
+         * Returns the furthest a PGS position sweep moves a contact's
+         * particles apart.
+         */
+        float getMaxCorrection() const;
+
+        /**
+         * Sets the way contacts are resolved.
+         */
+        void setMode(SolverMode mode);
+
+        /**
+         * Returns the way contacts are resolved.
+         */
+        SolverMode getMode() const;
+
+        /**
+         * Enables or disables warm starting, off by default. Only the
+         * PGS mode warm starts: the other modes resolve each contact
+         * greedily, and use their whole iteration budget on a pile
+         * whatever they start from, so they ignore this and zero the
+         * accumulated impulses. When on in the PGS mode, each contact's
+         * accumulatedImpulse must hold the impulse it applied last step
+         * (0 for a new contact), and the sweeps start from it. Either
+         * way the contacts hold the impulse applied this step afterwards.
+         */
+        void setWarmStarting(bool enabled);
+
+        /**
+         * Returns true if warm starting is on.
+         */
+        bool isWarmStarting() const;
+
         /**
          * Resolves a set of particle contacts for both penetration
          * and velocity.
@@ -132,11 +472,73 @@
 		 *
 		 * While the looping is likely to eventually settle into a correct answer,
 		 * there's no telling how long this will take.
+		 *
+		 * In the sequential mode contacts are kept in a heap keyed on separating
+		 * velocity, and after resolving a contact only the contacts sharing one
+		 * of its particles are updated, rather than rescanning every contact
+		 * each iteration. The contacts resolved, and their order, are the same
+		 * as a full scan.
+		 *
+		 * In the batched mode each iteration resolves one contact, and sweeps
+		 * over the colour batches stop once a sweep resolves nothing or the
+		 * iterations run out. The given pool runs each batch; without one the
+		 * batches are resolved on the calling thread.
+		 *
+		 * In the PGS mode each iteration is one contact visited by a sweep,
+		 * and the sweeps run on the calling thread.
+		 *
+		 * All particles involved must belong to the same store.
          *
         */
         void resolveContacts(ParticleContact *contactArray,
+            unsigned numContacts,
+            float duration,
+            ThreadPool *pool = 0);
+
+        /**
+         * Gets contacts ready for projectContacts to project over the
+         * substeps of a frame, for ParticleWorld::runPhysicsSubstepped.
+         * The particles must still be where the contacts were generated.
+         * Each contact's geometry is taken as fixed for the frame: its
+         * penetration at later positions is its generated penetration
+         * less how far its particles have since moved apart along its
+         * normal, and may be negative for contacts not touching yet.
+         * Contacts penetrating, or closing fast enough to touch within
+         * the frame, reverse the spin of their particles, as when
+         * resolving them.
+         */
+        void beginSubsteps(ParticleContact *contactArray,
             unsigned numContacts,
             float duration);
+
+        /**
+         * Projects the contacts given to beginSubsteps once, in order,
+         * after the particles have been integrated over a substep of the
+         * given length. Each contact still penetrating pushes its
+         * particles apart (an XPBD position constraint, with the
+         * compliance), changing their velocities to match the move. Then
+         * each contact pushed on has its separating velocity set to bounce
+         * by its restitution if it was closing when the substep began
+         * (faster than its particles' accelerations alone would close it),
+         * or to 0 if not. Each contact counts as one iteration, and has
+         * its penetration set to what it was before it was pushed on:
+         * negative if its particles haven't closed yet.
+         */
+        void projectContacts(ParticleContact *contactArray,
+            unsigned numContacts,
+            float substep);
+
+        /**
+         * Sets the compliance of the contacts when substepping, the
+         * inverse of their stiffness: 0 (the default) for rigid contacts,
+         * larger to let them give like springs.
+         */
+        void setCompliance(float compliance);
+
+        /**
+         * Returns the compliance of the contacts when substepping.
+         */
+        float getCompliance() const;
     };
 
     /**
@@ -152,6 +554,29 @@
          */
         virtual unsigned addContact(ParticleContact *contact,
                                     unsigned limit) const = 0;
+
+        /**
+         * Returns the number of parts the generator's contacts can be
+         * split in to, each of which may be generated on a different
+         * thread. Generators that can't be split have one part.
+         */
+        virtual unsigned getPartCount() const;
+
+        /**
+         * Does the work shared by all the parts (e.g. binning), before
+         * any part of this frame is generated.
+         */
+        virtual void prepareParts() const;
+
+        /**
+         * Fills the given contact array with the contacts of one part.
+         * Running every part in order gives the same contacts, in the
+         * same order, as addContact. By default the one part is just
+         * addContact.
+         */
+        virtual unsigned addPartContact(ParticleContact *contact,
+                                        unsigned limit,
+                                        unsigned part) const;
     };
 
 
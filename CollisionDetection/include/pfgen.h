@@ -0,0 +1,175 @@
+/*
+ * Interface file for the force generators.
+ *
+ */
+#ifndef PFGEN_H
+#define PFGEN_H
+
+#include <vector>
+#include "coreMath.h"
+#include "pstore.h"
+#include "threadpool.h"
+
+/*
+	Adds forces to a range of particles each step.
+
+	A generator is handed a contiguous range of rows of the store at a time,
+	rather than one particle, so there is one virtual call per range and the
+	generator's loop over the rows reads and writes the store's columns
+	directly, where the compiler can vectorise it.  Generators must only
+	touch the rows they are given, since other ranges of the same
+	registration may be updated at the same time on other threads.
+
+	Particles of infinite mass, and sleeping particles, should be skipped:
+	integration doesn't clear their force accumulators.
+*/
+class ParticleForceGenerator
+{
+public:
+	virtual ~ParticleForceGenerator() {}
+
+	// Adds this generator's forces to the particles in rows [begin, end).
+	virtual void updateForces(ParticleStore &store, unsigned begin, unsigned end, float duration) = 0;
+};
+
+/*
+	Pulls every particle with the same acceleration, whatever its mass.
+*/
+class ParticleGravity : public ParticleForceGenerator
+{
+public:
+	ParticleGravity(const Vector2 &gravity);
+
+	virtual void updateForces(ParticleStore &store, unsigned begin, unsigned end, float duration);
+
+	void setGravity(const Vector2 &gravity);
+	const Vector2& getGravity() const;
+
+private:
+	Vector2 gravity;
+};
+
+/*
+	Slows particles down with a force against their velocity of
+	k1 * speed + k2 * speed^2, i.e. a linear and a quadratic drag.
+*/
+class ParticleDrag : public ParticleForceGenerator
+{
+public:
+	ParticleDrag(float k1, float k2);
+
+	virtual void updateForces(ParticleStore &store, unsigned begin, unsigned end, float duration);
+
+private:
+	float k1;
+	float k2;
+};
+
+/*
+	Drags particles towards the velocity of the air around them, with a force
+	of coefficient * (wind velocity - particle velocity).  The wind can be
+	changed between steps for gusts.
+*/
+class ParticleWind : public ParticleForceGenerator
+{
+public:
+	ParticleWind(const Vector2 &velocity, float coefficient);
+
+	virtual void updateForces(ParticleStore &store, unsigned begin, unsigned end, float duration);
+
+	void setVelocity(const Vector2 &velocity);
+	const Vector2& getVelocity() const;
+
+private:
+	Vector2 velocity;
+	float coefficient;
+};
+
+/*
+	Ties every particle in its ranges to a fixed point with its own spring,
+	which pulls (or pushes) with a force of springConstant times how far the
+	particle is from restLength away from the anchor.
+*/
+class ParticleAnchoredSpring : public ParticleForceGenerator
+{
+public:
+	ParticleAnchoredSpring(const Vector2 &anchor, float springConstant, float restLength);
+
+	virtual void updateForces(ParticleStore &store, unsigned begin, unsigned end, float duration);
+
+	void setAnchor(const Vector2 &anchor);
+	const Vector2& getAnchor() const;
+
+private:
+	Vector2 anchor;
+	float springConstant;
+	float restLength;
+};
+
+/*
+	Pulls particles towards a point with an acceleration of strength divided
+	by the square of their distance from it, like a heavy body's gravity (a
+	negative strength pushes them away).  Distances below minDistance count
+	as minDistance, so particles passing through the point aren't flung off.
+*/
+class ParticleAttractor : public ParticleForceGenerator
+{
+public:
+	ParticleAttractor(const Vector2 &centre, float strength, float minDistance);
+
+	virtual void updateForces(ParticleStore &store, unsigned begin, unsigned end, float duration);
+
+	void setCentre(const Vector2 &centre);
+	const Vector2& getCentre() const;
+
+private:
+	Vector2 centre;
+	float strength;
+	float minDistance;
+};
+
+/*
+	Holds which force generators apply to which ranges of particles, and runs
+	them.
+
+	Registrations are run in the order they were added, each one's range
+	split in to fixed chunks shared across the pool, so the forces each
+	particle ends up with, and the order they were added in, don't depend on
+	the number of threads.
+*/
+class ParticleForceRegistry
+{
+public:
+	/*
+		Registers the generator to apply to count particles from the given
+		row of the store.  The registry doesn't own the generator.
+	*/
+	void add(ParticleForceGenerator *generator, unsigned first, unsigned count);
+
+	// Removes every registration of the generator.
+	void remove(ParticleForceGenerator *generator);
+
+	// Removes every registration, without deleting the generators.
+	void clear();
+
+	// Returns the number of registrations.
+	unsigned size() const;
+
+	/*
+		Runs every registration on the store, splitting each across the pool
+		if one is given.  Rows past the end of the store are skipped.
+	*/
+	void updateForces(ParticleStore &store, float duration, ThreadPool *pool = 0);
+
+private:
+	struct Registration
+	{
+		ParticleForceGenerator *generator;
+		unsigned first;
+		unsigned count;
+	};
+
+	std::vector<Registration> registrations;
+};
+
+#endif // PFGEN_H
@@ -0,0 +1,66 @@
+/*
+ * Interface file for running a world on its own thread.
+ *
+ */
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include <thread>
+#include <atomic>
+#include "pworld.h"
+#include "timestep.h"
+#include "snapshot.h"
+
+/*
+	Steps a world on a thread of its own, at the fixed rate of the given
+	timestep, and publishes a snapshot of the particles after each batch of
+	steps for another thread (e.g. the renderer) to read.
+
+	While the thread is running it is the only thing that may touch the world,
+	its particles, generators and the timestep; everyone else reads the
+	snapshots.  The world may still split each step over its own thread pool.
+*/
+class PhysicsThread
+{
+public:
+	PhysicsThread(ParticleWorld *world, FixedTimestep *timestep);
+
+	// Stops the thread if it is running.
+	~PhysicsThread();
+
+	// Publishes a snapshot of the current state and starts stepping.
+	void start();
+
+	// Stops stepping and waits for the thread to finish.
+	void stop();
+
+	bool isRunning() const;
+
+	/*
+		Returns the latest snapshot published by the physics thread.  Only one
+		thread may read snapshots.
+	*/
+	const ParticleSnapshot& acquireSnapshot();
+
+	// Returns the number of steps run since the thread was started.
+	unsigned long getStepCount() const;
+
+private:
+	// Thread body: steps the world as time passes until told to stop.
+	void run();
+
+	// Fills the back buffer from the world and publishes it.
+	void publishSnapshot();
+
+	ParticleWorld *world;
+	FixedTimestep *timestep;
+
+	SnapshotBuffer snapshots;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned long> stepCount;
+};
+
+#endif // PHYSICSTHREAD_H
@@ -0,0 +1,38 @@
+/*
+ * Interface file for the platform contact generator.
+ *
+ */
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include "pcontacts.h"
+
+/**
+ * Platforms are two dimensional lines on which 
+ * particles can rest. Platforms are also contact generators for the physics.
+ */
+
+class Platform : public ParticleContactGenerator
+{
+public:
+    Vector2 start;
+    Vector2 end;
+    /**
+     * Holds a pointer to the particles we're checking for collisions with. 
+     */
+    Particle *particles;
+
+    /**
+     * Holds the number of particles in the particles array.
+     */
+    unsigned numParticles;
+
+    Platform();
+
+    virtual unsigned addContact(
+        ParticleContact *contact, 
+        unsigned limit
+        ) const;
+};
+
+#endif // PLATFORM_H
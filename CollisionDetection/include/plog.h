@@ -0,0 +1,131 @@
+/*
+ * Interface file for the physics event log.
+ *
+ */
+#ifndef PLOG_H
+#define PLOG_H
+
+#include <atomic>
+
+/*
+	Logging levels.  Only events at or below PHYSICS_LOG_LEVEL are recorded;
+	the macros for the others only count the event, so disabled logging costs
+	no more than an atomic add.  By default builds with NDEBUG log nothing and
+	other builds log warnings and errors.
+*/
+#define PHYSICS_LOG_NONE 0
+#define PHYSICS_LOG_ERROR 1
+#define PHYSICS_LOG_WARN 2
+#define PHYSICS_LOG_INFO 3
+#define PHYSICS_LOG_DEBUG 4
+
+#ifndef PHYSICS_LOG_LEVEL
+#ifdef NDEBUG
+#define PHYSICS_LOG_LEVEL PHYSICS_LOG_NONE
+#else
+#define PHYSICS_LOG_LEVEL PHYSICS_LOG_WARN
+#endif
+#endif
+
+/*
+	Events raised by the physics.  Each event is counted, and written to an
+	in-memory ring buffer along with its level, where it came from and a value
+	(e.g. the number of contacts used).  Nothing is formatted or printed while
+	stepping; the records are drained and printed, if at all, by whoever reads
+	the log, off the physics thread.
+
+	Records are written without locks, so contact generators can log from any
+	thread of the world's pool.  When the buffer is full new records are
+	dropped (and counted) rather than waiting for the reader.
+*/
+class PhysicsLog
+{
+public:
+	enum Level
+	{
+		LEVEL_ERROR = PHYSICS_LOG_ERROR,
+		LEVEL_WARN = PHYSICS_LOG_WARN,
+		LEVEL_INFO = PHYSICS_LOG_INFO,
+		LEVEL_DEBUG = PHYSICS_LOG_DEBUG
+	};
+
+	enum Event
+	{
+		// A contact generator filled the contact buffer it was given.
+		EVENT_CONTACT_LIMIT,
+
+		// The resolver stopped because it ran out of iterations.
+		EVENT_ITERATIONS_EXHAUSTED,
+
+		EVENT_COUNT
+	};
+
+	struct Record
+	{
+		Level level;
+		Event event;
+
+		// Static string naming the code that raised the event.
+		const char *source;
+
+		unsigned value;
+	};
+
+	// Number of records the ring buffer holds.
+	enum { capacity = 4096 };
+
+	/*
+		Counts the event and adds a record of it to the ring buffer.  Use the
+		PLOG_ macros rather than calling this directly, so events above the
+		compiled level vanish.
+	*/
+	static void record(Level level, Event event, const char *source, unsigned value);
+
+	// Counts the event without recording it, for levels that aren't compiled in.
+	static void count(Event event);
+
+	/*
+		Moves up to maxRecords of the oldest records in to the given array,
+		returning the number moved.  Only one thread may drain at a time.
+	*/
+	static unsigned drain(Record *records, unsigned maxRecords);
+
+	// Returns the number of times the event has been raised.
+	static unsigned long long getCount(Event event);
+
+	// Returns the number of records lost because the buffer was full.
+	static unsigned long long getDropped();
+
+	// Zeroes the event counts and the dropped count.
+	static void resetCounts();
+
+	// Names for printing.
+	static const char* getEventName(Event event);
+	static const char* getLevelName(Level level);
+};
+
+#if PHYSICS_LOG_LEVEL >= PHYSICS_LOG_ERROR
+#define PLOG_ERROR(event, source, value) PhysicsLog::record(PhysicsLog::LEVEL_ERROR, event, source, value)
+#else
+#define PLOG_ERROR(event, source, value) PhysicsLog::count(event)
+#endif
+
+#if PHYSICS_LOG_LEVEL >= PHYSICS_LOG_WARN
+#define PLOG_WARN(event, source, value) PhysicsLog::record(PhysicsLog::LEVEL_WARN, event, source, value)
+#else
+#define PLOG_WARN(event, source, value) PhysicsLog::count(event)
+#endif
+
+#if PHYSICS_LOG_LEVEL >= PHYSICS_LOG_INFO
+#define PLOG_INFO(event, source, value) PhysicsLog::record(PhysicsLog::LEVEL_INFO, event, source, value)
+#else
+#define PLOG_INFO(event, source, value) PhysicsLog::count(event)
+#endif
+
+#if PHYSICS_LOG_LEVEL >= PHYSICS_LOG_DEBUG
+#define PLOG_DEBUG(event, source, value) PhysicsLog::record(PhysicsLog::LEVEL_DEBUG, event, source, value)
+#else
+#define PLOG_DEBUG(event, source, value) PhysicsLog::count(event)
+#endif
+
+#endif // PLOG_H
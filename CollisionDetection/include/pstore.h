@@ -0,0 +1,132 @@
+/*
+ * Interface file for the structure-of-arrays particle storage.
+ *
+ */
+#ifndef PSTORE_H
+#define PSTORE_H
+
+#include <vector>
+
+/*
+	Holds the state of every particle in a world as a set of parallel columns,
+	one entry per particle, rather than one object per particle.
+
+	Integration only needs a handful of these values for each particle, so
+	keeping each value contiguous means the integrator streams through exactly
+	the memory it uses instead of pulling whole particle objects in to cache.
+
+	Individual particles are accessed through Particle handles, which hold the
+	store and the row of the particle within it.
+*/
+class ParticleStore
+{
+public:
+	/*
+		The instruction set used to integrate the particles.  The vector paths
+		process 4 (SSE2) or 8 (AVX) particles at a time and agree with the
+		scalar path to within rounding (they are bitwise identical unless the
+		compiler contracts the scalar path's multiply-adds).
+	*/
+	enum IntegrationPath
+	{
+		// Pick the widest path the processor supports.
+		INTEGRATE_AUTO,
+		INTEGRATE_SCALAR,
+		INTEGRATE_SSE2,
+		INTEGRATE_AVX
+	};
+
+	// Position of each particle in world space.
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+
+	// Velocity of each particle with respect to the x and y axes.
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+
+	// Acceleration of each particle with respect to the axes.
+	std::vector<float> accelerationX;
+	std::vector<float> accelerationY;
+
+	// Acceleration each particle was last integrated with, forces included.
+	// Contact resolution reads this, since the force accumulators have been
+	// cleared by then.
+	std::vector<float> lastAccelerationX;
+	std::vector<float> lastAccelerationY;
+
+	// Force accumulators, cleared after each integration.
+	std::vector<float> forceAccumX;
+	std::vector<float> forceAccumY;
+
+	// Inverse mass of each particle, 0 for particles of infinite mass.
+	std::vector<float> inverseMass;
+
+	// Damping applied to linear and angular motion.
+	std::vector<float> damping;
+	std::vector<float> angularDamping;
+
+	std::vector<float> radius;
+
+	// Orientation in radians, and its rate of change.
+	std::vector<float> orientation;
+	std::vector<float> angularVelocity;
+	std::vector<float> angularAcceleration;
+
+	// Torque accumulator, cleared after each integration.
+	std::vector<float> torqueAccum;
+
+	// Non-zero for particles that are awake. Sleeping particles aren't integrated.
+	std::vector<unsigned char> awake;
+
+	ParticleStore();
+
+	/*
+		Appends an awake particle with all values zeroed, returning its index.
+	*/
+	unsigned add();
+
+	/*
+		Appends the given number of awake, zeroed particles, returning the
+		index of the first.
+	*/
+	unsigned add(unsigned count);
+
+	/*
+		Reserves room for the given number of particles so adding them
+		doesn't reallocate the columns.
+	*/
+	void reserve(unsigned count);
+
+	/*
+		Returns the number of particles held.
+	*/
+	unsigned size() const;
+
+	/*
+		Removes all particles.
+	*/
+	void clear();
+
+	/*
+		Integrates the particles in the range [begin, end) forward in time by
+		the given duration.
+	*/
+	void integrate(unsigned begin, unsigned end, float duration);
+
+	/*
+		Sets the path used to integrate the particles.  Requesting a path the
+		processor doesn't support falls back to the widest one it does.
+	*/
+	void setIntegrationPath(IntegrationPath path);
+
+	/*
+		Returns the path that will actually be used to integrate the particles.
+	*/
+	IntegrationPath getIntegrationPath() const;
+
+private:
+	// The resolved integration path (never INTEGRATE_AUTO).
+	IntegrationPath integrationPath;
+};
+
+#endif // PSTORE_H
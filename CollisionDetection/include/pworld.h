@@ -7,6 +7,11 @@
 
 #include <vector> 
 #include "pcontacts.h"
+#include "threadpool.h"
+#include "contactcache.h"
+#include "pfgen.h"
+
+class StaticSegments;
 
 /*
 	Keeps track of a set of particles providing a means to update them all.
@@ -17,12 +22,123 @@
         typedef std::vector<Particle*> Particles;
         typedef std::vector<ParticleContactGenerator*> ContactGenerators;
 
+        /**
+         * Accounting for the contact buffer, updated every frame.
+         */
+        struct ContactStats
+        {
+            /**
+             * Contacts the generators produced this frame.
+             */
+            unsigned requested;
+
+            /**
+             * Contacts over the contact limit this frame, which were
+             * not resolved.
+             */
+            unsigned dropped;
+
+            /**
+             * Number of contacts the buffer currently has room for.
+             */
+            unsigned capacity;
+
+            /**
+             * Most contacts requested in any frame so far.
+             */
+            unsigned highWater;
+
+            /**
+             * Number of times the buffer has grown.
+             */
+            unsigned growths;
+        };
+
+        /**
+         * Measurements of the last call to runPhysics. Times are wall
+         * clock seconds, and are only measured while step timing is
+         * enabled; the counts are always kept.
+         */
+        struct StepStats
+        {
+            /**
+             * Time spent integrating the particles.
+             */
+            float integrateTime;
+
+            /**
+             * Time spent running the contact generators.
+             */
+            float generateTime;
+
+            /**
+             * Time spent resolving the contacts.
+             */
+            float resolveTime;
+
+            /**
+             * Time spent waking and putting islands to sleep.
+             */
+            float sleepTime;
+
+            /**
+             * Time spent in the whole step.
+             */
+            float totalTime;
+
+            /**
+             * Contacts the generators produced.
+             */
+            unsigned contactsGenerated;
+
+            /**
+             * Contacts over the contact limit, which were not resolved.
+             */
+            unsigned contactsDropped;
+
+            /**
+             * Contacts handed to the resolver, after the limit and
+             * after dropping those between sleeping particles.
+             */
+            unsigned contactsResolved;
+
+            /**
+             * Contacts resolved that were found in the contact cache,
+             * and so warm started, when contact caching is on in the
+             * PGS mode.
+             */
+            unsigned contactsCached;
+
+            /**
+             * Iterations the resolver used, and the number it was allowed.
+             */
+            unsigned iterationsUsed;
+            unsigned iterationBudget;
+
+            /**
+             * Particles awake at the end of the step.
+             */
+            unsigned awakeCount;
+        };
+
     protected:
+        /**
+         * Holds the state of every particle created by this world,
+         * one column per value.
+         */
+        ParticleStore store;
+
         /**
          * Holds the particles
          */
         Particles particles;
 
+        /**
+         * Blocks of particle handles allocated by createParticles, kept
+         * so they can be deleted along with the world.
+         */
+        std::vector<Particle*> particleBlocks;
+
         /**
          * True if the world should calculate the number of iterations
          * to give the contact resolver at each frame.
@@ -40,21 +156,205 @@
         ContactGenerators contactGenerators;
 
         /**
-         * Holds the list of contacts.
+         * Holds the force generators for the particles in this world,
+         * run at the start of each step.
+         */
+        ParticleForceRegistry registry;
+
+        /**
+         * Holds the list of contacts. The buffer grows (doubling) when
+         * the generators fill it and never shrinks, so once it reaches
+         * the largest frame seen it stops reallocating.
+         */
+        std::vector<ParticleContact> contacts;
+
+        /**
+         * Holds the maximum number of contacts resolved in a frame, or 0
+         * for no limit. Contacts past the limit are counted as dropped.
+         */
+        unsigned contactLimit;
+
+        /**
+         * Holds the accounting for the contact buffer.
+         */
+        ContactStats contactStats;
+
+        /**
+         * Holds the measurements of the last step, and whether the
+         * phases of each step are timed.
+         */
+        StepStats stepStats;
+        bool stepTiming;
+
+        /**
+         * Grows the given buffer to at least the given size, doubling
+         * it if that is larger.
+         */
+        void growBuffer(std::vector<ParticleContact> &buffer, size_t size);
+
+        /**
+         * Applies the contact limit to the number of contacts generated
+         * and updates the contact accounting. Returns the number of
+         * contacts to resolve.
+         */
+        unsigned limitContacts(unsigned generated);
+
+        /**
+         * Worker threads used to split integration and contact
+         * generation across cores.
+         */
+        ThreadPool pool;
+
+        /**
+         * Scratch contact buffers, one per worker thread, that the
+         * generators write in to when they are run in parallel.
+         */
+        std::vector< std::vector<ParticleContact> > threadContacts;
+
+        /**
+         * Number of contacts written to each thread's buffer this frame.
+         */
+        std::vector<unsigned> threadUsed;
+
+        /**
+         * The parts of every generator run in parallel, in registration
+         * order: the generator and which of its parts each one is.
+         */
+        std::vector<unsigned> partGenerator;
+        std::vector<unsigned> partIndex;
+
+        /**
+         * Where each part's contacts ended up when run in parallel: the
+         * thread buffer and offset they were written to, how many there
+         * were, and where they start in the contact array.
+         */
+        std::vector<unsigned> partThread;
+        std::vector<unsigned> partOffset;
+        std::vector<unsigned> partUsed;
+        std::vector<unsigned> partStart;
+
+        /**
+         * Runs the parts of the contact generators concurrently and
+         * compacts their contacts in to the contact array. Returns the
+         * number of contacts generated.
+         */
+        unsigned generateContactsParallel();
+
+        /**
+         * Kinetic energy below which a particle counts as resting, and
+         * the number of consecutive frames a whole island must rest for
+         * before it is put to sleep. A threshold of 0 disables sleeping.
+         */
+        float sleepEnergy;
+        unsigned sleepFrames;
+
+        /**
+         * Union-find forest used to build the contact islands each frame,
+         * one entry per particle in the store.
+         */
+        std::vector<unsigned> islandParent;
+
+        /**
+         * The island each particle was in when it was put to sleep, so
+         * the whole island can be woken together.
+         */
+        std::vector<unsigned> islandId;
+
+        /**
+         * Number of consecutive frames each particle has been resting.
+         */
+        std::vector<unsigned> restFrames;
+
+        /**
+         * Per island scratch (indexed by the island's root particle): the
+         * highest kinetic energy of its particles, the fewest frames any of
+         * them has rested for, and whether it needs waking.
+         */
+        std::vector<float> islandEnergy;
+        std::vector<unsigned> islandRest;
+        std::vector<unsigned char> islandWake;
+
+        /**
+         * Number of particles awake after the last step.
+         */
+        unsigned awakeCount;
+
+        /**
+         * True if the contacts are put in a canonical order each step.
+         */
+        bool deterministic;
+
+        /**
+         * Sort key of a contact in determinism mode: the rows of the
+         * particles it involves, lower first (scenery counting as below
+         * every row), then its position in the generated order.
+         */
+        struct ContactKey
+        {
+            unsigned long long particles;
+            unsigned index;
+
+            bool operator<(const ContactKey &other) const
+            {
+                if (particles != other.particles) return particles < other.particles;
+                return index < other.index;
+            }
+        };
+
+        /**
+         * Scratch for putting the contacts in order: the key of each
+         * contact, and the reordered contacts.
+         */
+        std::vector<ContactKey> contactOrder;
+        std::vector<ParticleContact> sortedContacts;
+
+        /**
+         * True if contact impulses are carried between steps, and the
+         * cache carrying them.
+         */
+        bool contactCaching;
+        ContactCache contactCache;
+
+        /**
+         * The radius of each particle, kept while contacts for a
+         * substepped frame are generated with the particles grown by
+         * their margins, and each particle's margin: how far it could
+         * move in the frame.
+         */
+        std::vector<float> frameRadius;
+        std::vector<float> frameMargin;
+
+        /**
+         * Puts the given contacts in order of the rows of the particles
+         * they involve, keeping the generated order for contacts between
+         * the same particles.
+         */
+        void sortContacts(unsigned numContacts);
+
+        /**
+         * Returns the root of the island holding the given particle.
+         */
+        unsigned findIsland(unsigned particle);
+
+        /**
+         * Wakes every sleeping island touched by an awake particle, then
+         * removes the contacts that only involve sleeping (or immovable)
+         * particles. Returns the number of contacts left.
          */
-        ParticleContact *contacts;
+        unsigned wakeTouchedIslands(unsigned numContacts);
 
         /**
-         * Holds the maximum number of contacts allowed (i.e. the
-         * size of the contacts array).
+         * Builds the contact islands of the awake particles and puts to
+         * sleep the islands that have rested for long enough.
          */
-        unsigned maxContacts;
+        void updateSleeping(unsigned numContacts);
 
     public:
 
         /**
-         * Creates a new particle simulator that can handle up to the
-         * given number of contacts per frame. 
+         * Creates a new particle simulator with room for the given
+         * number of contacts per frame to begin with. The contact buffer
+         * grows when more contacts are generated.
          */
         ParticleWorld(unsigned maxContacts, unsigned iterations=0);
 
@@ -63,6 +363,14 @@
          */
         ~ParticleWorld();
 
+        /**
+         * Creates the given number of particles, with all values zeroed,
+         * and adds them to the list of particles. Returns a pointer to
+         * a contiguous array of handles to the new particles, which
+         * remain owned by the world.
+         */
+        Particle* createParticles(unsigned count);
+
         /**
          * Calls each of the registered contact generators to report
          * their contacts. Returns the number of generated contacts.
@@ -78,19 +386,179 @@
         /**
          * Run physics for the particle world, calling force generators to apply forces, performs integration of object,
 		 * runs contact detectors, and resolves the resulting contact list.
+		 *
+		 * The force generators in the force registry run first, over their
+		 * ranges of particles, split across the world's threads.
          */
         void runPhysics(float duration);
+
+        /**
+         * Runs physics for the given duration in the given number of
+         * equal substeps, projecting contacts as position constraints
+         * (XPBD) rather than resolving them with impulses. Many short
+         * substeps, each with a single projection pass over the contacts,
+         * stack dense piles more stiffly than iterating the resolver, so
+         * the world can be stepped less often.
+         *
+         * Contacts are generated once for the whole frame, with each
+         * particle grown by how far it could move in the frame, so those
+         * that may touch during the frame are found too (they are only
+         * pushed apart if they do). Each contact's geometry is then kept
+         * fixed over the substeps (see beginSubsteps). The resolver's mode
+         * and iterations aren't used, nor the contact cache; sleeping and
+         * determinism mode work as in runPhysics. The force generators
+         * run before every substep; forces added to the particles by hand
+         * before the call only act during the first substep.
+         */
+        void runPhysicsSubstepped(float duration, unsigned substeps);
 		
         /**
          *  Returns the list of particles.
          */
         Particles& getParticles();
 
+        /**
+         * Sets the number of threads used to step the world, including
+         * the thread calling runPhysics. The default of 1 steps the
+         * world on the calling thread only. Changing the thread count
+         * doesn't change the results of the simulation.
+         */
+        void setThreadCount(unsigned threadCount);
+
+        /**
+         * Returns the number of threads used to step the world.
+         */
+        unsigned getThreadCount() const;
+
+        /**
+         * Enables or disables determinism mode, off by default.
+         *
+         * The world always splits its work in to the same chunks and
+         * combines their results in a fixed order, so the thread count
+         * never changes the results. Determinism mode also sorts the
+         * contacts, before they are resolved, in to an order that only
+         * depends on the particles they involve, so the results don't
+         * depend on the order the generators found them in either (e.g.
+         * a broad phase whose order depends on its history, and so
+         * differs after loading a checkpoint). The sort costs a little
+         * each step, which is why it is optional.
+         *
+         * The contact limit is applied before sorting, so which contacts
+         * are dropped still depends on the generators' order.
+         */
+        void setDeterministic(bool enabled);
+
+        /**
+         * Returns true if determinism mode is on.
+         */
+        bool isDeterministic() const;
+
+        /**
+         * Enables or disables contact caching, off by default. When on,
+         * the impulse each contact applied is kept from one step to the
+         * next, keyed by the particles (or particle and generator) it
+         * involves, and the resolver is warm started from it, so contacts
+         * in settled piles start most of the way to resolved. Only the
+         * PGS mode warm starts (see setWarmStarting); the other modes
+         * ignore the cached impulses. Changing the setting forgets them,
+         * and they aren't saved in checkpoints.
+         */
+        void setContactCaching(bool enabled);
+
+        /**
+         * Returns true if contact caching is on.
+         */
+        bool isContactCaching() const;
+
+        /**
+         * Sets the most contacts resolved in a frame, or 0 (the default)
+         * for no limit. Generators still report every contact, so the
+         * number over the limit can be counted.
+         */
+        void setContactLimit(unsigned limit);
+
+        /**
+         * Returns the contact buffer accounting for the last frame.
+         */
+        const ContactStats& getContactStats() const;
+
+        /**
+         * Enables or disables timing the phases of each step. Timing
+         * reads the clock a few times a step, so it is off by default.
+         */
+        void setStepTiming(bool enabled);
+
+        /**
+         * Returns the measurements of the last call to runPhysics.
+         */
+        const StepStats& getStepStats() const;
+
+        /**
+         * Enables putting islands of particles in contact to sleep once
+         * the kinetic energy of each of their particles has stayed below
+         * the given threshold for the given number of frames. Sleeping
+         * particles aren't integrated or resolved, and wake when an awake
+         * particle touches their island. A threshold of 0 (the default)
+         * disables sleeping.
+         */
+        void setSleeping(float energyThreshold, unsigned frames);
+
+        /**
+         * Returns the number of particles that were awake after the
+         * last step.
+         */
+        unsigned getAwakeCount() const;
+
+        /**
+         * Writes the particles, the resolver and world settings, and
+         * optionally a set of static segments, to a checkpoint file.
+         * Returns false if the file couldn't be written.
+         */
+        bool saveCheckpoint(const char *path, const StaticSegments *segments = 0);
+
+        /**
+         * Restores the particles and settings from a checkpoint file.
+         * Particles are restored in to the rows of the store, creating
+         * any the world doesn't have yet (their handles are added to
+         * getParticles()), so a scene can be built as usual and then
+         * have its state loaded over it. If segments are given they are
+         * replaced with the checkpoint's. Returns false, leaving the
+         * world untouched, if the file isn't a valid checkpoint or holds
+         * fewer particles than the world.
+         */
+        bool loadCheckpoint(const char *path, StaticSegments *segments = 0);
+
+        /**
+         * Returns a 64 bit hash of the bits of every particle's state
+         * (everything a checkpoint holds for it), for checking that two
+         * runs, or a faster path and the one it replaces, ended up in
+         * exactly the same place. It isn't cryptographic.
+         */
+        unsigned long long getChecksum() const;
+
+        /**
+         * Returns the resolver used to resolve the contacts, e.g. to
+         * change its mode.
+         */
+        ParticleContactResolver& getResolver();
+
+        /**
+         * Returns the store holding the state of the particles.
+         */
+        ParticleStore& getStore();
+
         /**
          * Returns the list of contact generators.
          */
         ContactGenerators& getContactGenerators();
 
+        /**
+         * Returns the force registry, to register force generators over
+         * ranges of rows of the store (createParticles returns
+         * contiguous rows).
+         */
+        ParticleForceRegistry& getForceRegistry();
+
     };
 
 
@@ -0,0 +1,228 @@
+/*
+ * Interface file for recording particle trajectories to disk.
+ *
+ */
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "pstore.h"
+
+/*
+	The recorded state of every particle at one step, one column per value.
+*/
+struct TrajectoryFrame
+{
+	enum { columnCount = 5 };
+
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+	std::vector<float> orientation;
+
+	unsigned long step;
+
+	TrajectoryFrame() : step(0) {}
+
+	// Sizes every column for the given number of particles.
+	void resize(unsigned count);
+
+	// Returns a column, in the order they are declared above.
+	std::vector<float>& getColumn(unsigned column);
+	const std::vector<float>& getColumn(unsigned column) const;
+};
+
+/*
+	A recording is a header, the encoded frames one after another, the index
+	(one entry per frame) and a footer giving where the index starts.  Each
+	frame holds, column by column, the zigzag encoded difference between each
+	quantised value and the one before it, as a base 128 varint.  Keyframes
+	take the difference from zero.
+*/
+struct TrajectoryHeader
+{
+	// "PWTRAJ01"
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t particleCount;
+	uint32_t keyframeInterval;
+	float quanta[TrajectoryFrame::columnCount];
+};
+
+// Where a frame starts in the file, its size and the step it was recorded at.
+struct TrajectoryIndexEntry
+{
+	uint64_t offset;
+	uint32_t size;
+	uint32_t keyframe;
+	uint64_t step;
+};
+
+struct TrajectoryFooter
+{
+	uint64_t indexOffset;
+	uint32_t frameCount;
+	uint32_t reserved;
+	// "PWTRAJIX"
+	char magic[8];
+};
+
+/*
+	Records the positions, velocities and orientations of a world's particles
+	after each step, without holding up the step.
+
+	record() only copies the state in to the next buffer of a preallocated
+	ring and returns.  A background thread takes the frames off the ring,
+	quantises each value to a fixed step, takes the difference from the same
+	value in the previous frame, and packs those (mostly tiny) differences as
+	variable length integers, so a particle at rest costs a byte per value.
+	Encoded frames are gathered and written in large sequential chunks.
+
+	Every keyframeInterval frames a frame is stored whole rather than as a
+	difference, and an index of where each frame starts is written when the
+	recording is closed, so a TrajectoryReader can jump to any frame by
+	decoding at most keyframeInterval frames.
+
+	If the background thread falls so far behind that the ring is full, the
+	frame is dropped (and counted) rather than waiting.
+*/
+class TrajectoryRecorder
+{
+public:
+	// Creates a recorder with a ring of the given number of frame buffers.
+	TrajectoryRecorder(unsigned ringFrames = 16);
+
+	// Closes the recording if it is still open.
+	~TrajectoryRecorder();
+
+	/*
+		Starts recording the given number of particles to the file at path.
+		Values are stored to the nearest multiple of their quantum.  Returns
+		false if the file can't be created.
+	*/
+	bool open(const char *path, unsigned particleCount,
+		float positionQuantum = 1e-4f,
+		float velocityQuantum = 1e-4f,
+		float orientationQuantum = 1e-4f,
+		unsigned keyframeInterval = 64);
+
+	/*
+		Queues the current state of the store as the frame for the given step.
+		Returns false if the frame was dropped because the ring was full, or
+		the store doesn't hold the number of particles being recorded.
+	*/
+	bool record(const ParticleStore &store, unsigned long step);
+
+	/*
+		Writes any queued frames and the index, and closes the file.  Returns
+		false if anything couldn't be written.
+	*/
+	bool close();
+
+	bool isOpen() const;
+
+	// Number of frames encoded and dropped so far.
+	unsigned getRecordedFrames() const;
+	unsigned getDroppedFrames() const;
+
+private:
+	// Background thread body: encodes and writes queued frames until closed.
+	void run();
+
+	// Encodes a frame in to the write buffer, flushing it when it is large.
+	void encodeFrame(const TrajectoryFrame &frame);
+
+	// Writes the write buffer to the file.
+	void flush();
+
+	FILE *file;
+	unsigned particleCount;
+	float quanta[TrajectoryFrame::columnCount];
+	unsigned keyframeInterval;
+
+	// Ring of frames waiting to be encoded.  Frames tail - 1 back to head are
+	// filled; only record() moves tail and only the thread moves head.
+	std::vector<TrajectoryFrame> ring;
+	std::atomic<unsigned> head;
+	std::atomic<unsigned> tail;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable frameReady;
+	std::atomic<bool> closing;
+
+	// Encoder state, owned by the background thread.
+	std::vector<int32_t> previous;
+	std::vector<unsigned char> writeBuffer;
+	uint64_t writeOffset;
+	bool writeFailed;
+
+	// Start, size and step of each encoded frame, for the index.
+	std::vector<TrajectoryIndexEntry> index;
+
+	std::atomic<unsigned> recordedFrames;
+	std::atomic<unsigned> droppedFrames;
+};
+
+/*
+	Reads frames back from a recording made by TrajectoryRecorder.
+*/
+class TrajectoryReader
+{
+public:
+	TrajectoryReader();
+	~TrajectoryReader();
+
+	/*
+		Opens a recording and reads its index.  Returns false if it isn't
+		one, or if its header, index or footer don't fit the file.
+	*/
+	bool open(const char *path);
+	void close();
+
+	unsigned getParticleCount() const;
+	unsigned getFrameCount() const;
+
+	// Returns the step a frame was recorded at.
+	unsigned long getStep(unsigned frame) const;
+
+	// Returns the quantum a column's values were stored to.
+	float getQuantum(unsigned column) const;
+
+	/*
+		Decodes the given frame.  Reading frames in order decodes each once;
+		jumping decodes forward from the keyframe at or before the frame.
+	*/
+	bool readFrame(unsigned frame, TrajectoryFrame &result);
+
+private:
+	// Checks the header and footer against the size of the file.
+	bool validate(const TrajectoryHeader &header, const TrajectoryFooter &footer, uint64_t size) const;
+
+	// Checks that an index entry lies inside the frames and could hold one.
+	bool validate(const TrajectoryIndexEntry &entry, const TrajectoryHeader &header, const TrajectoryFooter &footer) const;
+
+	// Decodes the next frame on from the current one (or a keyframe).
+	bool decodeFrame(unsigned frame);
+
+	FILE *file;
+	unsigned particleCount;
+	float quanta[TrajectoryFrame::columnCount];
+
+	std::vector<TrajectoryIndexEntry> index;
+
+	// The last frame decoded, as quantised values, or -1 if none.
+	int current;
+	std::vector<int32_t> values;
+	std::vector<unsigned char> readBuffer;
+};
+
+#endif // RECORDER_H
@@ -0,0 +1,115 @@
+/*
+ * Interface file for the static segment contact generator.
+ *
+ */
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include <vector>
+#include "coreMath.h"
+#include "particle.h"
+#include "pcontacts.h"
+
+class Platform;
+
+/*
+	A set of static line segments (platforms, walls, level geometry) that
+	particles collide with, used as a single contact generator for all of them.
+
+	Segments never move, so everything a contact test needs that only depends
+	on the segment (its direction, the inverse of its squared length and its
+	bounding box) is worked out once when the set is built.  The segments are
+	then indexed by a bounding volume hierarchy, and each particle only tests
+	the segments whose boxes overlap its own, so the cost of a frame scales
+	with the geometry near each particle rather than with the size of the level.
+
+	The hierarchy is built lazily, on the first query after segments are added.
+*/
+class StaticSegments : public ParticleContactGenerator {
+public:
+	// A baked segment.
+	struct Segment {
+		Vector2 start;
+		Vector2 end;
+
+		// end - start, and 1 / |end - start|^2 (0 for a segment of no length).
+		Vector2 direction;
+		float inverseSquareLength;
+
+		// Bounding box of the segment.
+		Vector2 min;
+		Vector2 max;
+
+		float restitution;
+	};
+
+private:
+	/*
+		A node of the hierarchy.  Leaves hold count segments starting at first;
+		interior nodes have count 0 and their children at first and first + 1.
+	*/
+	struct Node {
+		Vector2 min;
+		Vector2 max;
+		unsigned first;
+		unsigned count;
+	};
+
+	// Segments in the order they were added, so a set rebuilt from them
+	// (e.g. from a checkpoint) builds the same hierarchy.
+	std::vector<Segment> added;
+
+	// Segments, reordered so each leaf's segments are contiguous.
+	mutable std::vector<Segment> segments;
+
+	mutable std::vector<Node> nodes;
+	mutable bool built;
+
+	// The particles tested against the segments.
+	const std::vector<Particle*> *particles;
+
+	// Builds the hierarchy over the segments.
+	void build() const;
+
+	// Builds the subtree for segments [first, first + count) in to the given node.
+	void buildNode(unsigned node, unsigned first, unsigned count) const;
+
+	/*
+		Tests a particle against a segment, filling the given contact structure
+		if they are touching.  Returns true if the contact was used.
+	*/
+	bool testSegment(Particle *particle, const Segment &segment, ParticleContact *contact) const;
+
+public:
+	StaticSegments();
+	~StaticSegments();
+
+	// Adds a segment between the given points.
+	void addSegment(const Vector2 &start, const Vector2 &end, float restitution = 0.8f);
+
+	// Adds the segment of each of the given platforms.
+	void addPlatforms(const Platform *platforms, unsigned count);
+
+	// Removes all the segments.
+	void clear();
+
+	unsigned getSegmentCount() const;
+
+	// Returns a segment, in the order they were added.
+	const Segment& getSegment(unsigned index) const;
+
+	/*
+		Sets the particles tested against the segments.  The pointer is kept, so
+		particles added to the list later are picked up automatically.
+	*/
+	void setParticles(const std::vector<Particle*> *particles);
+
+	/*
+		Fills the given contact array with the contacts between particles and
+		the segments their bounding boxes overlap.
+	*/
+	virtual unsigned addContact(ParticleContact *contact,
+		unsigned limit) const;
+};
+
+#endif // SEGMENTS_H
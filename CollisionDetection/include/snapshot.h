@@ -0,0 +1,100 @@
+/*
+ * Interface file for the particle snapshots passed from physics to rendering.
+ *
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+/*
+	The state of every particle needed to draw a frame, one column per value
+	and one row per particle, in the same order as the world's store.
+
+	The state before the last step is kept too, so the reader can interpolate
+	between the two for the time it draws at: the physics thread only publishes
+	when it steps, so only the reader knows how far in to the next step it is.
+*/
+struct ParticleSnapshot
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> orientation;
+	std::vector<float> radius;
+
+	// Position and orientation before the last step.
+	std::vector<float> previousX;
+	std::vector<float> previousY;
+	std::vector<float> previousOrientation;
+
+	// Number of physics steps run when the snapshot was taken.
+	unsigned long step;
+
+	// When the snapshot was published, the length of a step, and how far the
+	// timestep's accumulator was in to the next step at the time (0 to 1).
+	Clock::time_point time;
+	float stepDuration;
+	float interpolation;
+
+	ParticleSnapshot() : step(0), stepDuration(0), interpolation(1.0f) {}
+
+	unsigned size() const { return (unsigned)positionX.size(); }
+
+	/*
+		Returns the fraction, from 0 up to 1, to interpolate from the previous
+		to the current state when drawing at the given time.  Drawing runs a
+		step behind the physics, so this reaches 1 about when the next
+		snapshot is due.
+	*/
+	float getInterpolation(Clock::time_point now) const;
+};
+
+/*
+	A triple buffer passing snapshots from one writing thread to one reading
+	thread without locks.
+
+	The writer fills the back buffer and publishes it, swapping it with the
+	middle buffer.  The reader swaps the middle buffer in to the front when a
+	new one has been published.  Neither side ever waits for the other: the
+	writer always has a buffer to fill, and the reader always has the most
+	recent complete snapshot, so a slow frame on one side doesn't stall the
+	other.
+*/
+class SnapshotBuffer
+{
+public:
+	SnapshotBuffer();
+
+	// Returns the buffer to fill with the next snapshot (writer only).
+	ParticleSnapshot& getBack();
+
+	// Makes the back buffer available to the reader (writer only).
+	void publish();
+
+	/*
+		Returns the most recently published snapshot (reader only).  The
+		snapshot stays valid and unchanged until the next call.
+	*/
+	const ParticleSnapshot& acquire();
+
+	// True if a snapshot has been published since the last acquire.
+	bool hasNewSnapshot() const;
+
+private:
+	ParticleSnapshot buffers[3];
+
+	// Index of the middle buffer, with freshBit set when the writer has
+	// published it and the reader hasn't yet taken it.
+	std::atomic<unsigned> middle;
+	enum { indexMask = 3, freshBit = 4 };
+
+	// Owned by the writer and the reader respectively.
+	unsigned back;
+	unsigned front;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,75 @@
+/*
+ * Interface file for the sort-and-sweep broad phase.
+ *
+ */
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <vector>
+#include "coreMath.h"
+#include "particle.h"
+#include "pcontacts.h"
+
+/*
+	A sweep-and-prune broad phase, used as a single sphere-sphere contact
+	generator for every particle in the world, as an alternative to the grid.
+
+	The particles' bounding boxes are kept sorted by their lowest x from one
+	frame to the next.  Each time contacts are requested the boxes are updated
+	and re-sorted with an insertion sort, which only has to move the few
+	particles that overtook a neighbour since the last frame, so is close to
+	linear when motion is small.  A sweep along the sorted list then only pairs
+	particles whose boxes overlap on x, and those also overlapping on y go on to
+	the sphere narrow phase.
+
+	Unlike the grid there is no cell size to tune, so particles of very
+	different sizes and tightly packed piles don't degrade it.
+*/
+class SweepAndPrune : public ParticleContactGenerator {
+private:
+	// Bounding box of a particle, in the sorted order.
+	struct Entry {
+		float minX;
+		float maxX;
+		float minY;
+		float maxY;
+		Particle *particle;
+	};
+
+	// Kept sorted by minX between frames, hence mutable.
+	mutable std::vector<Entry> entries;
+
+	// The particles swept by this generator.
+	const std::vector<Particle*> *particles;
+
+	// Restitution given to generated contacts.
+	float restitution;
+
+	// Refreshes the bounding boxes and re-sorts them by minX.
+	void updateEntries() const;
+
+	// Rebuilds the entries from the particle list, when particles have been added or removed.
+	void rebuildEntries() const;
+
+public:
+	SweepAndPrune();
+	~SweepAndPrune();
+
+	/*
+		Sets the particles this generator sweeps.  It holds on to the pointer,
+		so particles added to the list later are picked up automatically.
+	*/
+	void setParticles(const std::vector<Particle*> *particles);
+
+	// Sets the restitution given to generated contacts.
+	void setRestitution(float restitution);
+
+	/*
+		Re-sorts the particles and fills the given contact array with
+		sphere-sphere contacts between particles whose bounding boxes overlap.
+	*/
+	virtual unsigned addContact(ParticleContact *contact,
+		unsigned limit) const;
+};
+
+#endif // SWEEP_H
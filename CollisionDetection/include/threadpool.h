@@ -0,0 +1,89 @@
+/*
+ * Interface file for the worker pool used to step the world on several cores.
+ *
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/*
+	A fixed set of worker threads that persist between frames, so splitting a
+	phase of the step across cores doesn't pay for creating threads each time.
+
+	Work is handed out as a parallel-for over a range of indices.  The range is
+	always split in to the same chunks (set by the grain size) regardless of the
+	number of threads, so a task that only writes to its own chunk produces the
+	same results whatever the thread count.
+*/
+class ThreadPool
+{
+public:
+	/*
+		The task run for each chunk: the first and one past the last index of
+		the chunk, and the index of the thread running it (0 is the calling
+		thread, workers are 1 to getThreadCount() - 1).
+	*/
+	typedef std::function<void(unsigned begin, unsigned end, unsigned thread)> Task;
+
+	/*
+		Creates a pool running tasks on the given number of threads, including
+		the thread calling parallelFor.  A count of 0 or 1 runs everything on the
+		calling thread.
+	*/
+	ThreadPool(unsigned threadCount = 1);
+
+	// Stops and joins the worker threads.
+	~ThreadPool();
+
+	/*
+		Changes the number of threads, stopping or starting workers as needed.
+		Must not be called while a parallelFor is running.
+	*/
+	void setThreadCount(unsigned threadCount);
+
+	// Returns the number of threads tasks are run on, including the caller.
+	unsigned getThreadCount() const;
+
+	/*
+		Runs the task over [0, count) in chunks of grainSize indices, returning
+		once every chunk has been run.  The calling thread runs chunks too.
+	*/
+	void parallelFor(unsigned count, unsigned grainSize, const Task &task);
+
+private:
+	// Worker thread body: waits for jobs and runs their chunks.
+	void workerLoop(unsigned thread);
+
+	// Claims and runs chunks of the current job until none are left.
+	void runChunks(unsigned thread);
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	// Signalled when a new job is posted or the pool is stopping.
+	std::condition_variable jobReady;
+	// Signalled when a worker finishes with a job.
+	std::condition_variable jobDone;
+
+	// Incremented for each job so workers can tell a new job from the last one.
+	unsigned long jobGeneration;
+	bool stopping;
+	// Workers currently running chunks of a job, guarded by the mutex.
+	unsigned activeWorkers;
+
+	// The current job.
+	const Task *task;
+	unsigned count;
+	unsigned grainSize;
+	unsigned chunkCount;
+	std::atomic<unsigned> nextChunk;
+	std::atomic<unsigned> chunksDone;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,96 @@
+/*
+ * Interface file for the fixed timestep scheduler.
+ *
+ */
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+#include <vector>
+#include "coreMath.h"
+#include "pworld.h"
+
+/*
+	Steps a world by a fixed duration, however much time passes between calls.
+
+	Elapsed time is added to an accumulator, and the world is stepped once for
+	each whole step the accumulator holds.  The simulation, and the cost of each
+	step, is then the same whether frames come quickly or slowly, and physics
+	can run at a lower (or higher) rate than rendering.
+
+	If stepping falls behind, e.g. after a stall, the number of steps run in one
+	call is clamped and the time that couldn't be caught up is dropped, rather
+	than running ever more steps each frame to catch up.
+
+	The time left in the accumulator is a fraction of a step, which is used to
+	interpolate between the last two steps when rendering, so motion stays
+	smooth when the render and physics rates don't match.
+*/
+class FixedTimestep
+{
+public:
+	/*
+		Creates a scheduler stepping the given world stepDuration seconds at a
+		time, running at most maxSubsteps steps per call to advance.
+	*/
+	FixedTimestep(ParticleWorld *world, float stepDuration = 0.01f, unsigned maxSubsteps = 5);
+
+	void setStepDuration(float stepDuration);
+	float getStepDuration() const;
+
+	void setMaxSubsteps(unsigned maxSubsteps);
+	unsigned getMaxSubsteps() const;
+
+	/*
+		Adds the given number of seconds to the accumulator and steps the world
+		for as many whole steps as it holds, up to the substep limit.  Returns
+		the number of steps run.
+	*/
+	unsigned advance(float elapsed);
+
+	/*
+		Returns how far the accumulator is in to the next step, from 0 up to 1.
+		Rendering at this fraction between the previous and current states shows
+		where the particles are at the time advance was last called.
+	*/
+	float getInterpolation() const;
+
+	/*
+		Returns the position and orientation of the particle in the given row of
+		the world's store, interpolated between the last two steps.
+	*/
+	Vector2 getPosition(unsigned index) const;
+	float getOrientation(unsigned index) const;
+
+	/*
+		Returns the position and orientation of the particle before the last
+		step, or its current ones if it was created since.
+	*/
+	Vector2 getPreviousPosition(unsigned index) const;
+	float getPreviousOrientation(unsigned index) const;
+
+	// Returns the total seconds dropped because the substep limit was hit.
+	float getDroppedTime() const;
+
+	// Empties the accumulator and forgets the previous state.
+	void reset();
+
+private:
+	// Copies the current state of the particles as the previous state.
+	void savePreviousState();
+
+	ParticleWorld *world;
+
+	float stepDuration;
+	unsigned maxSubsteps;
+
+	// Time not yet simulated, always less than one step after advance.
+	float accumulator;
+	float droppedTime;
+
+	// Position and orientation of each particle before the last step.
+	std::vector<float> previousX;
+	std::vector<float> previousY;
+	std::vector<float> previousOrientation;
+};
+
+#endif // TIMESTEP_H
@@ -2,11 +2,18 @@
  * The Blob demo.
  *
  */
-#include <gl/glut.h>
-#include "app.h"
+#include <GL/glut.h>
+#include "App.h"
 #include "coreMath.h"
 #include "pcontacts.h"
 #include "pworld.h"
+#include "grid.h"
+#include "platform.h"
+#include "segments.h"
+#include "timestep.h"
+#include "physicsthread.h"
+#include "blobrenderer.h"
+#include "plog.h"
 #include <stdio.h>
 #include <cassert>
 #include <vector>
@@ -20,188 +27,6 @@
 #define numBlobs 25
 
 
-// Definition of acceleration due to gravity
-const Vector2 Vector2::GRAVITY = Vector2(0,-9.81);
-
-class Sphere : public ParticleContactGenerator
-{
-public:
-	// Particle this generator is associated with
-	Particle* thisParticle;
-	float radius;
-
-	// Particles potentially colliding with this one;
-	std::vector<Particle*> particles;
-
-	// Method to determine how contact structures will be filled.
-	virtual unsigned addContact(
-		ParticleContact* contact,
-		unsigned limit) const;
-};
-
-unsigned Sphere::addContact(ParticleContact* contact, unsigned limit) const{
-	const static float restitution = 1.0f;
-	unsigned used = 0;
-
-	// Get position of this particle
-	Vector2 position = thisParticle->getPosition();
-
-	for (std::vector<Particle*>::const_iterator it = particles.begin(); it != particles.end(); it++){
-		if (used > limit) {
-			std::cout << "Sphere-Sphere contact generator: Contact limit used.";
-			break;
-		}
-
-		Vector2 candidatePos = (*it)->getPosition();
-		float candidateRadius = (*it)->getRadius();
-
-		// Check for interpenetration:
-		float spheresPosXSqrd = position.x - candidatePos.x;
-		spheresPosXSqrd *= spheresPosXSqrd;
-		float spheresPosYSqrd = position.y - candidatePos.y;
-		spheresPosYSqrd *= spheresPosYSqrd;
-
-		// Calculate and square the sum of the radii
-		float sumRadiiSquared = radius + candidateRadius;
-		// Square sum of radii to avoid square root (computationally cheaper)
-		sumRadiiSquared *= sumRadiiSquared;
-
-		// If distance between centres <= sum of radii, we have a collision (face-face contact).
-		// Test 1: are spheres touching or intersecting?
-		if ((spheresPosXSqrd + spheresPosYSqrd) <= sumRadiiSquared){
-			std::cout << "Sphere-Sphere: Touch/intersection detected\n";
-			// find vector between this object and the candidate object
-			Vector2 dist = position - candidatePos;
-			// Take magnitude of this distance (giving us the size vector between these objects)
-			float size = dist.magnitude();
-			// Get the contact normal (normal of the vector from centre of first object through centre of second)
-			Vector2 normal = dist * (((float)1.0) / size);
-			
-			// The intersection may be noticable, populate contact structure
-			// for collision processing
-			contact->contactNormal = normal;
-			contact->restitution = restitution;
-			contact->particle[0] = thisParticle;
-			contact->particle[1] = (*it);
-			// Calculate and populate contact structure penetration value.
-			contact->penetration = (radius + candidateRadius - size);
-			contact->contactPoint = position + dist * (float)0.5;
-
-			// Increment number of used contacts
-			used++;	
-			// Move to the next available contact object
-			contact++;
-		}
-	}
-
-	return used;
-}
-
-/**
- * Platforms are two dimensional lines on which 
- * particles can rest. Platforms are also contact generators for the physics.
- */
-
-class Platform : public ParticleContactGenerator
-{
-public:
-    Vector2 start;
-    Vector2 end;
-    /**
-     * Holds a pointer to the particles we're checking for collisions with. 
-     */
-    Particle *particles;
-
-    virtual unsigned addContact(
-        ParticleContact *contact, 
-        unsigned limit
-        ) const;
-};
-
-unsigned Platform::addContact(ParticleContact *contact, 
-                              unsigned limit) const
-{
-    
-	const static float restitution = 0.8f;
-	//const static float restitution = 1.0f;
-	unsigned used = 0;
-    
-	for (int i = 0; i < numBlobs; i++){
-		if (used > limit) {
-			std::cout << "Platform contact generator: Contact limit used." << std::endl;
-			break;
-		}
-
-		// Check for penetration
-		// Get distance to particle from start point
-		Vector2 toParticle = particles[i].getPosition() - start;
-		Vector2 lineDirection = end - start;
-
-		// Get projected distance from distance to particle multiplied
-		// by the direction of the line
-		float projected = toParticle * lineDirection;
-		float platformSqLength = lineDirection.squareMagnitude();
-		// Get the squared radius of the particle to aviod using square root in calculations
-		float squareRadius = particles[i].getRadius()*particles[i].getRadius();
-
-		if (projected <= 0)
-		{
-			// The blob is nearest to the start point
-			if (toParticle.squareMagnitude() < squareRadius)
-			{
-				// We have a collision, populate the contact structure accordingly.
-				contact->contactNormal = toParticle.unit();
-				contact->restitution = restitution;
-				contact->particle[0] = particles + i;
-				contact->particle[1] = 0;
-				contact->penetration = particles[i].getRadius() - toParticle.magnitude();
-				used++;
-				contact++;
-			}
-
-		}
-		else if (projected >= platformSqLength)
-		{
-
-			// Update particle position with respect to the end point of the platform
-			toParticle = particles[i].getPosition() - end;
-			
-			// The blob is nearest to the end point
-			if (toParticle.squareMagnitude() < squareRadius)
-			{
-				// We have a collision, populate the contact structure accordingly.
-				contact->contactNormal = toParticle.unit();
-				contact->restitution = restitution;
-				contact->particle[0] = particles + i;
-				contact->particle[1] = 0;
-				contact->penetration = particles[i].getRadius() - toParticle.magnitude();
-				used++;
-				contact++;
-			}
-		}
-		else
-		{
-			// the blob is between the start and end points.
-			float distanceToPlatform = toParticle.squareMagnitude() - projected*projected / platformSqLength;
-			if (distanceToPlatform < squareRadius)
-			{
-				// We have a collision, populate the contact structure accordingly.
-				Vector2 closestPoint = start + lineDirection*(projected / platformSqLength);
-
-				contact->contactNormal = (particles[i].getPosition() - closestPoint).unit();
-				contact->restitution = restitution;
-				contact->particle[0] = particles + i;
-				contact->particle[1] = 0;
-				contact->penetration = particles[i].getRadius() - sqrt(distanceToPlatform);
-				used++;
-				contact++;
-			}
-		}
-	}
-
-    return used;
-}
-
 class NonConvexPoly : public ParticleContactGenerator
 {
 public:
@@ -230,12 +55,30 @@ class BlobDemo : public Application
 	Particle *blobs;
 
     Platform *platforms;
-	Sphere *spheres;
+
+	// The platforms baked in to a single contact generator.
+	StaticSegments segments;
+
+	// Broad phase generating the sphere-sphere contacts between all blobs.
+	Grid grid;
+
+	// Pulls every blob down, registered with the world's force registry.
+	ParticleGravity gravity;
 
 	// Holds all contact generators and particle contacts in this
 	// simulation world
     ParticleWorld world;
 
+	// Steps the world at a fixed rate, independent of the frame rate.
+	FixedTimestep timestep;
+
+	// Runs the timestep on its own thread, handing snapshots of the blobs
+	// to display.
+	PhysicsThread physicsThread;
+
+	// Draws all the blobs in a couple of batches.
+	BlobRenderer renderer;
+
 public:
     /** Creates a new demo object. */
     BlobDemo();
@@ -249,18 +92,21 @@ public:
 
     /** Update the particle positions. */
     virtual void update();
+
+    /** Resize the view, and tell the renderer what's in it. */
+    virtual void resize(int width, int height);
 	
 };
 
 // Method definitions
-BlobDemo::BlobDemo():world(10, 10)
+BlobDemo::BlobDemo():grid(200, 200, 4), gravity(Vector2::GRAVITY * 20.0f), world(10, 10), timestep(&world, 0.01f, 5), physicsThread(&world, &timestep)
 {
 	width = 400; height = 400; 
 	nRange = 100.0;
 
-    // Create the blob storage
-    //blob = new Particle;
-	blobs = new Particle[numBlobs];
+    // Create the blob storage, the world holds the state of each blob
+    // and hands back an array of handles to it.
+	blobs = world.createParticles(numBlobs);
 
 	// Create the platforms (4 for box + user given numPlatforms)
 	platforms = new Platform[4+numPlatforms];
@@ -291,15 +137,11 @@ BlobDemo::BlobDemo():world(10, 10)
 		}
 	}
 
-	// Register all blobs with all platform contact generators,
-	// and all contact generators with the particle world.
-	for (int i = 0; i < 4+numPlatforms; i++){
-		platforms[i].particles = blobs;
-		world.getContactGenerators().push_back(platforms + i);
-	}
-
-	// One sphere contact generator per blob.
-	spheres = new Sphere[numBlobs];
+	// Bake the platforms in to one generator testing every blob against
+	// the platforms near it, and register it with the particle world.
+	segments.addPlatforms(platforms, 4+numPlatforms);
+	segments.setParticles(&world.getParticles());
+	world.getContactGenerators().push_back(&segments);
 
 	// Make blobs
 	float mass = 1.0f;
@@ -313,9 +155,6 @@ BlobDemo::BlobDemo():world(10, 10)
 		// than calculating a force)
 		blobs[i].setDamping(0.8f);
 		blobs[i].setAngularDamping(0.8f);
-		// Apply acceleration due to gravity directly
-		// (This could be added as a force)
-		blobs[i].setAcceleration(Vector2::GRAVITY * 20.0f);
 		blobs[i].setAngularVelocity(10.0f);
 		blobs[i].setAngularAcceleration(0.0f);
 		blobs[i].setMass(mass);
@@ -323,38 +162,37 @@ BlobDemo::BlobDemo():world(10, 10)
 		blobs[i].setOrientation(0);
 		blobs[i].clearAccumulators();
 
-		// Set position and radius for this blob's contact generator
-		//spheres[i].position = blobs[i].getPosition();
-		spheres[i].radius = blobs[i].getRadius();
-
-		world.getParticles().push_back(blobs + i);
 		offset += 5.0f;
 		//mass += mass+mass;
 		//radius += radius;
 	}
 
-	// Register contacts between spheres
-	for (int i = 0; i < numBlobs; i++){
-		for (int j = 0; j < numBlobs; j++){
-			if (i == j){
-				// Pass particle reference to sphere
-				spheres[i].thisParticle = &blobs[i];
-			}
-			// Don't have a sphere check for contacts against its self!
-			if (j != i){
-
-				spheres[i].particles.push_back(blobs + j);
-			}
-		}
-		// Add this contact generator to world's contact generators.
-		world.getContactGenerators().push_back(spheres + i);
-	}
+	// Gravity acts on every blob, which are contiguous rows of the world's
+	// store, in one batch.
+	world.getForceRegistry().add(&gravity, blobs[0].getIndex(), numBlobs);
+
+	// A single grid generates the contacts between spheres. Its cell size
+	// must be at least the diameter of the largest blob.
+	grid.setParticles(&world.getParticles());
+	world.getContactGenerators().push_back(&grid);
+
+	// Let blobs that have come to rest sleep. Resting blobs pick up about
+	// 2 units of energy from gravity each frame before their contact
+	// cancels it, so the threshold needs to sit above that.
+	world.setSleeping(5.0f, 30);
+
+	// Everything is set up, hand the world over to the physics thread.
+	physicsThread.start();
 }
 
 
 BlobDemo::~BlobDemo()
 {
-    delete blobs;
+	// Stop stepping before anything the world uses goes away.
+	physicsThread.stop();
+
+    // Blobs are owned by the world.
+    delete[] platforms;
 }
 
 void BlobDemo::display()
@@ -372,70 +210,44 @@ void BlobDemo::display()
   }
    glEnd();
 
-   int r = 1.0f;
-   int g = 0.0f;
-   int b = 00.0f;
-
-   for (int i = 0; i < numBlobs; i++){
-
-	   const Vector2 &p = blobs[i].getPosition();
-	   const float radius = blobs[i].getRadius();
-	   // Convert orientation to degrees and store it
-	   const float &orientation = blobs[i].getOrientation() * 180/3.1459;
-	   glPushMatrix();
-	   glLoadIdentity();
-	   // Position the sphere
-	   glTranslatef(p.x, p.y, 0);
-	   glRotatef(orientation, 0, 0, 1.0f);
-
-	   //glColor3f(r, g, b);
-	   //glBegin(GL_POLYGON);
-	   //glVertex3f(2.0, 4.0, 0.0);
-	   //glVertex3f(8.0, 4.0, 0.0);
-	   //glVertex3f(8.0, 6.0, 0.0);
-	   //glVertex3f(2.0, 6.0, 0.0);
-	   //glEnd();
-
-	   // Draw the sphere
-	   glColor3f(r, g, b);
-	   glutSolidSphere(blobs[i].getRadius(), 12, 12);
-
-	   // Draw a black line from sphere centre to top of sphere
-	   glColor3f(0.0f, 0.0f, 0.0f);
-	   glBegin(GL_LINES);
-	   glVertex2f(p.x, p.y);
-	   glVertex2f(p.x, p.y + radius);
-	   glEnd();
-
-	   glPopMatrix();
-
-	   if (r != 0){
-		   r = 0;
-		   g = 1;
-	   }
-	   else if (g != 0){
-		   g = 0;
-		   b = 1;
-	   }
-	   else if (b != 0){
-		   b = 0;
-		   r = 1;
-	   }
-   }
+   // The physics thread owns the blobs, draw its latest snapshot of them.
+   const ParticleSnapshot &snapshot = physicsThread.acquireSnapshot();
+   renderer.draw(snapshot, snapshot.getInterpolation(ParticleSnapshot::Clock::now()));
 
 	glutSwapBuffers();
+
+	// Print whatever the physics logged since the last frame.
+	PhysicsLog::Record records[64];
+	unsigned count = PhysicsLog::drain(records, 64);
+	for (unsigned i = 0; i < count; i++){
+		std::cout << PhysicsLog::getLevelName(records[i].level) << ": "
+			<< records[i].source << ": "
+			<< PhysicsLog::getEventName(records[i].event)
+			<< " (" << records[i].value << ")" << std::endl;
+	}
 }
 
 void BlobDemo::update()
 {
-    // Recenter the axes
-	float duration = timeinterval/1000;
-    // Run the simulation
-    world.runPhysics(duration);
-
+	// The simulation runs on the physics thread, just redraw with its
+	// latest snapshot.
     Application::update();
 }
 
+void BlobDemo::resize(int width, int height)
+{
+	Application::resize(width, height);
+
+	// Work out the same clipping volume as Application::resize, which only
+	// keeps it rounded to whole units.
+	if (height == 0) height = 1;
+	float aspectRatio = (float)width / (float)height;
+	float halfWidth = (width <= height) ? nRange : nRange*aspectRatio;
+	float halfHeight = (width <= height) ? nRange/aspectRatio : nRange;
+
+	renderer.setView(-halfWidth, halfWidth, -halfHeight, halfHeight, width);
+}
+
 const char* BlobDemo::getTitle()
 {
     return "Blob Demo";
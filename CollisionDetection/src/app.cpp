@@ -1,6 +1,6 @@
 
-#include <gl/glut.h>
-#include "app.h"
+#include <GL/glut.h>
+#include "App.h"
 
 int Application::getwidth()
 {
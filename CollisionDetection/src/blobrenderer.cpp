@@ -0,0 +1,131 @@
+#include <GL/glut.h>
+#include <blobrenderer.h>
+#include <math.h>
+
+// Colours the blobs cycle through.
+static const unsigned char blobColours[3][3] = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 } };
+
+// Pixels along the edge of a disc per segment; finer levels are picked until
+// segments are about this long.
+static const float pixelsPerSegment = 4.0f;
+
+BlobRenderer::BlobRenderer()
+:
+left(-100.0f),
+right(100.0f),
+bottom(-100.0f),
+top(100.0f),
+pixelsPerUnit(2.0f),
+drawnCount(0),
+culledCount(0)
+{
+	for (unsigned level = 0; level < levels; level++){
+		unsigned segments = 6u << level;
+		circles[level].resize(segments * 2);
+		for (unsigned s = 0; s < segments; s++){
+			float angle = 2.0f * 3.14159265f * s / segments;
+			circles[level][s * 2] = cosf(angle);
+			circles[level][s * 2 + 1] = sinf(angle);
+		}
+	}
+}
+
+void BlobRenderer::setView(float left, float right, float bottom, float top, int pixelWidth)
+{
+	BlobRenderer::left = left;
+	BlobRenderer::right = right;
+	BlobRenderer::bottom = bottom;
+	BlobRenderer::top = top;
+	pixelsPerUnit = (right > left) ? pixelWidth / (right - left) : 1.0f;
+}
+
+unsigned BlobRenderer::getDrawnCount() const
+{
+	return drawnCount;
+}
+
+unsigned BlobRenderer::getCulledCount() const
+{
+	return culledCount;
+}
+
+unsigned BlobRenderer::getLevel(float radius) const
+{
+	float circumference = 2.0f * 3.14159265f * radius * pixelsPerUnit;
+
+	unsigned level = 0;
+	while (level + 1 < levels && (6u << level) * pixelsPerSegment < circumference) level++;
+	return level;
+}
+
+void BlobRenderer::addDisc(float x, float y, float radius, unsigned level, const unsigned char *colour)
+{
+	const std::vector<float> &circle = circles[level];
+	unsigned segments = (unsigned)circle.size() / 2;
+
+	for (unsigned s = 0; s < segments; s++){
+		unsigned next = (s + 1 == segments) ? 0 : s + 1;
+
+		discVertices.push_back(x);
+		discVertices.push_back(y);
+		discVertices.push_back(x + circle[s * 2] * radius);
+		discVertices.push_back(y + circle[s * 2 + 1] * radius);
+		discVertices.push_back(x + circle[next * 2] * radius);
+		discVertices.push_back(y + circle[next * 2 + 1] * radius);
+
+		for (unsigned v = 0; v < 3; v++){
+			discColours.push_back(colour[0]);
+			discColours.push_back(colour[1]);
+			discColours.push_back(colour[2]);
+		}
+	}
+}
+
+void BlobRenderer::draw(const ParticleSnapshot &snapshot, float alpha)
+{
+	discVertices.clear();
+	discColours.clear();
+	lineVertices.clear();
+	drawnCount = 0;
+	culledCount = 0;
+
+	unsigned count = snapshot.size();
+	for (unsigned i = 0; i < count; i++){
+		float x = snapshot.previousX[i] + (snapshot.positionX[i] - snapshot.previousX[i]) * alpha;
+		float y = snapshot.previousY[i] + (snapshot.positionY[i] - snapshot.previousY[i]) * alpha;
+		float radius = snapshot.radius[i];
+
+		// Skip blobs entirely outside the view.
+		if (x + radius < left || x - radius > right || y + radius < bottom || y - radius > top){
+			culledCount++;
+			continue;
+		}
+		drawnCount++;
+
+		addDisc(x, y, radius, getLevel(radius), blobColours[i % 3]);
+
+		// A line from the centre to the edge, pointing up at an orientation of 0.
+		float orientation = snapshot.previousOrientation[i] +
+			(snapshot.orientation[i] - snapshot.previousOrientation[i]) * alpha;
+		lineVertices.push_back(x);
+		lineVertices.push_back(y);
+		lineVertices.push_back(x - sinf(orientation) * radius);
+		lineVertices.push_back(y + cosf(orientation) * radius);
+	}
+
+	if (drawnCount == 0) return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 0, &discVertices[0]);
+	glColorPointer(3, GL_UNSIGNED_BYTE, 0, &discColours[0]);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(discVertices.size() / 2));
+	glDisableClientState(GL_COLOR_ARRAY);
+
+	glColor3f(0.0f, 0.0f, 0.0f);
+	glVertexPointer(2, GL_FLOAT, 0, &lineVertices[0]);
+	glDrawArrays(GL_LINES, 0, (GLsizei)(lineVertices.size() / 2));
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
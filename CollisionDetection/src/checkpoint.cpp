@@ -0,0 +1,181 @@
+#include <checkpoint.h>
+#include <pcontacts.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::vector<float> ParticleStore::* const checkpointFloatColumns[CHECKPOINT_FLOAT_COLUMNS] =
+{
+	&ParticleStore::positionX,
+	&ParticleStore::positionY,
+	&ParticleStore::velocityX,
+	&ParticleStore::velocityY,
+	&ParticleStore::accelerationX,
+	&ParticleStore::accelerationY,
+	&ParticleStore::lastAccelerationX,
+	&ParticleStore::lastAccelerationY,
+	&ParticleStore::forceAccumX,
+	&ParticleStore::forceAccumY,
+	&ParticleStore::inverseMass,
+	&ParticleStore::damping,
+	&ParticleStore::angularDamping,
+	&ParticleStore::radius,
+	&ParticleStore::orientation,
+	&ParticleStore::angularVelocity,
+	&ParticleStore::angularAcceleration,
+	&ParticleStore::torqueAccum
+};
+
+CheckpointView::CheckpointView()
+:
+data(0),
+size(0)
+{
+}
+
+CheckpointView::~CheckpointView()
+{
+	close();
+}
+
+bool CheckpointView::open(const char *path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(CheckpointHeader)){
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	CloseHandle(file);
+	if (!mapping) return false;
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view) return false;
+
+	data = (const unsigned char*)view;
+	size = (size_t)fileSize.QuadPart;
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < (off_t)sizeof(CheckpointHeader)){
+		::close(file);
+		return false;
+	}
+
+	void *view = mmap(0, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (view == MAP_FAILED) return false;
+
+	data = (const unsigned char*)view;
+	size = (size_t)status.st_size;
+#endif
+
+	if (!validate()){
+		close();
+		return false;
+	}
+	return true;
+}
+
+void CheckpointView::close()
+{
+	if (!data) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+	data = 0;
+	size = 0;
+}
+
+bool CheckpointView::isOpen() const
+{
+	return data != 0;
+}
+
+bool CheckpointView::validate() const
+{
+	const CheckpointHeader &header = getHeader();
+
+	if (memcmp(header.magic, "PWORLDCK", 8) != 0) return false;
+	if (header.version != CHECKPOINT_VERSION) return false;
+	if (header.byteOrder != 0x01020304) return false;
+	if (header.headerSize != sizeof(CheckpointHeader)) return false;
+	if (header.fileSize != size) return false;
+
+	// The settings are cast straight to their enums, so must be in range.
+	if (header.solverMode > ParticleContactResolver::SOLVE_PGS) return false;
+	if (header.integrationPath > ParticleStore::INTEGRATE_AVX) return false;
+
+	uint64_t count = header.particleCount;
+	for (unsigned c = 0; c < CHECKPOINT_COLUMNS; c++){
+		uint64_t bytes = count * sizeof(float);
+		if (c == CHECKPOINT_AWAKE_COLUMN) bytes = count;
+		if (c == CHECKPOINT_REST_COLUMN || c == CHECKPOINT_ISLAND_COLUMN) bytes = count * sizeof(uint32_t);
+
+		uint64_t offset = header.columnOffset[c];
+		if (offset % CHECKPOINT_ALIGNMENT != 0 || offset > size || bytes > size - offset) return false;
+	}
+
+	uint64_t segmentBytes = (uint64_t)header.segmentCount * sizeof(CheckpointSegment);
+	if (header.segmentOffset % CHECKPOINT_ALIGNMENT != 0 || header.segmentOffset > size ||
+		segmentBytes > size - header.segmentOffset) return false;
+
+	// The world indexes by island, so each must be a row.
+	const uint32_t *islands = getIslands();
+	for (uint64_t i = 0; i < count; i++){
+		if (islands[i] >= count) return false;
+	}
+
+	return true;
+}
+
+const CheckpointHeader& CheckpointView::getHeader() const
+{
+	return *(const CheckpointHeader*)data;
+}
+
+const float* CheckpointView::getFloatColumn(unsigned column) const
+{
+	return (const float*)(data + getHeader().columnOffset[column]);
+}
+
+const unsigned char* CheckpointView::getAwake() const
+{
+	return data + getHeader().columnOffset[CHECKPOINT_AWAKE_COLUMN];
+}
+
+const uint32_t* CheckpointView::getRestFrames() const
+{
+	return (const uint32_t*)(data + getHeader().columnOffset[CHECKPOINT_REST_COLUMN]);
+}
+
+const uint32_t* CheckpointView::getIslands() const
+{
+	return (const uint32_t*)(data + getHeader().columnOffset[CHECKPOINT_ISLAND_COLUMN]);
+}
+
+const CheckpointSegment* CheckpointView::getSegments() const
+{
+	return (const CheckpointSegment*)(data + getHeader().segmentOffset);
+}
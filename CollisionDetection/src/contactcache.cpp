@@ -0,0 +1,147 @@
+#include <contactcache.h>
+#include <algorithm>
+
+// Mixes a key in to a hash, so nearby rows spread across the table.
+static unsigned hashKey(unsigned first, unsigned second, unsigned tag)
+{
+	unsigned long long hash = first * 0x9e3779b97f4a7c15ull;
+	hash ^= (second + 0x632be59bd9b4e019ull) * 0xc2b2ae3d27d4eb4full;
+	hash ^= tag * 0x165667b19e3779f9ull;
+	hash ^= hash >> 29;
+	return (unsigned)hash;
+}
+
+unsigned ContactCache::Table::find(unsigned first, unsigned second, unsigned tag) const
+{
+	unsigned slot = hashKey(first, second, tag) & mask;
+	while (entries[slot].used)
+	{
+		const Entry &entry = entries[slot];
+		if (entry.first == first && entry.second == second && entry.tag == tag) break;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+ContactCache::ContactCache()
+:
+fetched(0),
+hits(0)
+{
+	clear();
+}
+
+void ContactCache::clear()
+{
+	Entry empty = emptyEntry();
+	previous.entries.assign(1, empty);
+	previous.mask = 0;
+	current.entries.assign(1, empty);
+	current.mask = 0;
+	fetched = 0;
+	hits = 0;
+}
+
+ContactCache::Entry ContactCache::emptyEntry()
+{
+	Entry entry;
+	entry.first = 0;
+	entry.second = 0;
+	entry.tag = 0;
+	entry.impulse = 0;
+	entry.used = false;
+	return entry;
+}
+
+Vector2 ContactCache::makeKey(const ParticleContact &contact, Entry &entry)
+{
+	if (!contact.particle[1])
+	{
+		entry.first = contact.particle[0]->getIndex();
+		entry.second = 0;
+		// The ordinal is filled in by fetch().
+		entry.tag = contact.generator << 8;
+		return contact.contactNormal;
+	}
+
+	// Generators may report a pair either way round from one step to the
+	// next, so key it lower row first, with the normal pointing to match.
+	unsigned first = contact.particle[0]->getIndex();
+	unsigned second = contact.particle[1]->getIndex();
+	entry.tag = 0;
+	if (first < second)
+	{
+		entry.first = first;
+		entry.second = second + 1;
+		return contact.contactNormal;
+	}
+	entry.first = second;
+	entry.second = first + 1;
+	return contact.contactNormal * -1;
+}
+
+void ContactCache::fetch(ParticleContact *contacts, unsigned count)
+{
+	// Keep the table at most half full, so probes stay short.
+	unsigned size = 16;
+	while (size < count * 2) size *= 2;
+
+	current.entries.assign(size, emptyEntry());
+	current.mask = size - 1;
+
+	contactSlot.resize(count);
+	fetched = count;
+	hits = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		ParticleContact &contact = contacts[i];
+		Entry entry;
+		Vector2 normal = makeKey(contact, entry);
+
+		// Scenery contacts with the same key so far this step take the
+		// next ordinal.
+		unsigned slot = current.find(entry.first, entry.second, entry.tag);
+		while (current.entries[slot].used && entry.second == 0 && (entry.tag & 0xff) < 0xff)
+		{
+			entry.tag++;
+			slot = current.find(entry.first, entry.second, entry.tag);
+		}
+
+		entry.impulse = 0;
+		entry.normal = normal;
+		entry.used = true;
+		current.entries[slot] = entry;
+		contactSlot[i] = slot;
+
+		contact.accumulatedImpulse = 0;
+		const Entry &last = previous.entries[previous.find(entry.first, entry.second, entry.tag)];
+		if (!last.used) continue;
+		hits++;
+
+		// Only the part of the old impulse along the new normal still pushes
+		// the same way.
+		float alignment = last.normal * normal;
+		if (alignment > 0) contact.accumulatedImpulse = last.impulse * alignment;
+	}
+}
+
+void ContactCache::store(const ParticleContact *contacts, unsigned count)
+{
+	for (unsigned i = 0; i < count && i < contactSlot.size(); i++)
+	{
+		current.entries[contactSlot[i]].impulse = contacts[i].accumulatedImpulse;
+	}
+
+	std::swap(previous, current);
+}
+
+unsigned ContactCache::getFetched() const
+{
+	return fetched;
+}
+
+unsigned ContactCache::getHits() const
+{
+	return hits;
+}
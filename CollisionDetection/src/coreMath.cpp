@@ -0,0 +1,4 @@
+#include <coreMath.h>
+
+// Definition of acceleration due to gravity
+const Vector2 Vector2::GRAVITY = Vector2(0,-9.81);
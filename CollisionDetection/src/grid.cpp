@@ -1,21 +1,173 @@
 #include <grid.h>
+#include <narrowphase.h>
+#include <plog.h>
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
 
 
-Grid::Grid(int width, int height, int cellSize) {
+Grid::Grid(int width, int height, int cellSize)
+:
+particles(0),
+restitution(1.0f)
+{
 	/*
 		Creates a grid of cells corresponding to the given width & height (should be the size of the created environment).
-	
+
 	*/
+	// A cell must be at least a unit across, or there would be no cells to
+	// divide the environment in to.
+	assert(cellSize > 0);
+	if (cellSize < 1) cellSize = 1;
 
+	Grid::cellSize = (float)cellSize;
+	inverseCellSize = 1.0f / Grid::cellSize;
 
+	// Round up so the whole environment is covered.
+	columns = (width + cellSize - 1) / cellSize;
+	rows = (height + cellSize - 1) / cellSize;
+	if (columns < 1) columns = 1;
+	if (rows < 1) rows = 1;
 
+	// The environment is centred on the origin.
+	origin = Vector2(columns * Grid::cellSize * -0.5f, rows * Grid::cellSize * -0.5f);
 
+	cells.resize(columns * rows);
 }
 
 Grid::~Grid() {
 
 }
 
-Cell* getCell(float x, float y) {
-	return nullptr;
-}
\ No newline at end of file
+void Grid::setParticles(const std::vector<Particle*> *particles)
+{
+	Grid::particles = particles;
+}
+
+void Grid::setRestitution(float restitution)
+{
+	Grid::restitution = restitution;
+}
+
+int Grid::getColumn(float x) const
+{
+	int column = (int)floor((x - origin.x) * inverseCellSize);
+	if (column < 0) return 0;
+	if (column >= columns) return columns - 1;
+	return column;
+}
+
+int Grid::getRow(float y) const
+{
+	int row = (int)floor((y - origin.y) * inverseCellSize);
+	if (row < 0) return 0;
+	if (row >= rows) return rows - 1;
+	return row;
+}
+
+Cell* Grid::getCell(float x, float y) {
+	return &cells[getRow(y) * columns + getColumn(x)];
+}
+
+void Grid::binParticles() const
+{
+	// Empty last frame's cells, keeping their storage so we don't reallocate
+	// every frame.
+	for (std::vector<unsigned>::const_iterator c = occupiedCells.begin(); c != occupiedCells.end(); c++){
+		cells[*c].occupants.clear();
+	}
+	occupiedCells.clear();
+
+	if (!particles) return;
+
+	for (std::vector<Particle*>::const_iterator p = particles->begin(); p != particles->end(); p++){
+		Vector2 position = (*p)->getPosition();
+		unsigned index = getRow(position.y) * columns + getColumn(position.x);
+
+		std::vector<Particle*> &occupants = cells[index].occupants;
+		if (occupants.empty()) occupiedCells.push_back(index);
+		occupants.push_back(*p);
+	}
+
+	// Row major order, so a row's cells can be found by a binary search.
+	std::sort(occupiedCells.begin(), occupiedCells.end());
+}
+
+unsigned Grid::addContact(ParticleContact *contact, unsigned limit) const
+{
+	binParticles();
+	return addCellContacts(0, (unsigned)occupiedCells.size(), contact, limit);
+}
+
+unsigned Grid::getPartCount() const
+{
+	return (unsigned)rows;
+}
+
+void Grid::prepareParts() const
+{
+	binParticles();
+}
+
+unsigned Grid::addPartContact(ParticleContact *contact, unsigned limit, unsigned part) const
+{
+	// The occupied cells of the row, which are together as they're sorted.
+	std::vector<unsigned>::const_iterator begin = occupiedCells.begin(), end = occupiedCells.end();
+	std::vector<unsigned>::const_iterator first = std::lower_bound(begin, end, part * columns);
+	std::vector<unsigned>::const_iterator last = std::lower_bound(first, end, (part + 1) * columns);
+
+	return addCellContacts((unsigned)(first - begin), (unsigned)(last - begin), contact, limit);
+}
+
+unsigned Grid::addCellContacts(unsigned first, unsigned last, ParticleContact *contact, unsigned limit) const
+{
+	unsigned used = 0;
+
+	/*
+		Each cell tests pairs within itself, and against half of its neighbours
+		(right, and the three cells above), so each pair of cells is only visited once.
+	*/
+	static const int neighbourOffsets[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+	for (unsigned c = first; c < last; c++){
+		unsigned index = occupiedCells[c];
+		const std::vector<Particle*> &occupants = cells[index].occupants;
+		int column = index % columns;
+		int row = index / columns;
+
+		for (unsigned i = 0; i < occupants.size(); i++){
+			// Pairs within this cell.
+			for (unsigned j = i + 1; j < occupants.size(); j++){
+				if (used >= limit){
+					PLOG_INFO(PhysicsLog::EVENT_CONTACT_LIMIT, "grid", used);
+					return used;
+				}
+				if (sphereContact(occupants[i], occupants[j], restitution, contact)){
+					used++;
+					contact++;
+				}
+			}
+
+			// Pairs with the neighbouring cells.
+			for (int n = 0; n < 4; n++){
+				int neighbourColumn = column + neighbourOffsets[n][0];
+				int neighbourRow = row + neighbourOffsets[n][1];
+				if (neighbourColumn < 0 || neighbourColumn >= columns || neighbourRow >= rows) continue;
+
+				const std::vector<Particle*> &neighbours = cells[neighbourRow * columns + neighbourColumn].occupants;
+				for (unsigned j = 0; j < neighbours.size(); j++){
+					if (used >= limit){
+						PLOG_INFO(PhysicsLog::EVENT_CONTACT_LIMIT, "grid", used);
+						return used;
+					}
+					if (sphereContact(occupants[i], neighbours[j], restitution, contact)){
+						used++;
+						contact++;
+					}
+				}
+			}
+		}
+	}
+
+	return used;
+}
@@ -1,6 +1,6 @@
-#include <gl/glut.h>
+#include <GL/glut.h>
 
-#include "app.h"
+#include "App.h"
 extern Application* getApplication();
 Application* app;
 
@@ -1,198 +1,206 @@
-
 #include "particle.h"
 #include <math.h>
 #include <assert.h>
 #include <float.h>
 
-// Update position and velocity of the particle based on the given duration.
-void Particle::integrate(float duration)
+Particle::Particle()
+:
+store(0),
+index(0)
 {
+}
 
-	// We don't integrate things with zero mass.
-   if (inverseMass <= 0.0f) return;
-
-	assert(duration > 0.0);
-	// update position based on linear velocity
-	position.addScaledVector(velocity, duration);
-	// update orientation based on angular velocity
-	orientation += angularVelocity * duration;
-
-	// Work out the linear acceleration from force
-    Vector2 resultingAcc = acceleration;
-    resultingAcc.addScaledVector(forceAccum, inverseMass);
-
-	// Work out angular acceleration from force
-	float angularAcc = angularAcceleration;
-	angularAcc += torqueAccum;
-
-	// Update linear velocity from the acceleration and impulse.
-    velocity.addScaledVector(resultingAcc, duration);
+void Particle::bind(ParticleStore *store, unsigned index)
+{
+	Particle::store = store;
+	Particle::index = index;
+}
 
-	// Update angular velocity from impulse
-	angularVelocity += angularAcc * duration;
+ParticleStore* Particle::getStore() const
+{
+	return store;
+}
 
-	// Impose drag.
-	velocity *= pow(damping, duration);
-	angularVelocity *= pow(angularDamping, duration);
+unsigned Particle::getIndex() const
+{
+	return index;
+}
 
-	// Clear accumulated forces and torques now they have been integrated.
-    clearAccumulators();
+// Update position and velocity of the particle based on the given duration.
+void Particle::integrate(float duration)
+{
+	store->integrate(index, index + 1, duration);
 }
 
 void Particle::setMass(const float mass)
 {
     assert(mass != 0);
-    Particle::inverseMass = ((float)1.0)/mass;
+    store->inverseMass[index] = ((float)1.0)/mass;
 }
 
 float Particle::getMass() const
 {
-    if (inverseMass == 0) {
+    if (store->inverseMass[index] == 0) {
         return DBL_MAX;
     } else {
-        return ((float)1.0)/inverseMass;
+        return ((float)1.0)/store->inverseMass[index];
     }
 }
 
 void Particle::setInverseMass(const float inverseMass)
 {
-    Particle::inverseMass = inverseMass;
+    store->inverseMass[index] = inverseMass;
 }
 
 float Particle::getInverseMass() const
 {
-    return inverseMass;
+    return store->inverseMass[index];
 }
 
 bool Particle::hasFiniteMass() const
 {
-    return inverseMass >= 0.0f;
+    return store->inverseMass[index] >= 0.0f;
 }
 
 
 void Particle::setDamping(const float damping)
 {
-    Particle::damping = damping;
+    store->damping[index] = damping;
 }
 
 float Particle::getDamping() const
 {
-    return damping;
+    return store->damping[index];
 }
 
 void Particle::setAngularDamping(const float damping) {
-	angularDamping = damping;
+	store->angularDamping[index] = damping;
 }
 
 float Particle::getAngularDamping() const {
-	return angularDamping;
+	return store->angularDamping[index];
 }
 
 void Particle::setPosition(const float x, const float y)
 {
-    position.x = x;
-    position.y = y;
+    store->positionX[index] = x;
+    store->positionY[index] = y;
 }
 
 void Particle::setPosition(const Vector2 &position)
 {
-	 Particle::position = position;
+	setPosition(position.x, position.y);
 }
 
 
 Vector2 Particle::getPosition() const
 {
-    return position;
+    return Vector2(store->positionX[index], store->positionY[index]);
 }
 
 void Particle::getPosition(Vector2 *position) const
 {
-    *position = Particle::position;
+    *position = getPosition();
 }
 
 void Particle::setRadius(const float r)
 {
-    radius = r;
+    store->radius[index] = r;
 }
 
 float Particle::getRadius() const
 {
-    return radius;
+    return store->radius[index];
 }
 
 
 void Particle::setVelocity(const float x, const float y)
 {
-    velocity.x = x;
-    velocity.y = y;
+    store->velocityX[index] = x;
+    store->velocityY[index] = y;
 }
 
 void Particle::setVelocity(const Vector2 &velocity)
 {
-    Particle::velocity = velocity;
+    setVelocity(velocity.x, velocity.y);
 }
 
 Vector2 Particle::getVelocity() const
 {
-    return velocity;
+    return Vector2(store->velocityX[index], store->velocityY[index]);
 }
 
 void Particle::getVelocity(Vector2 *velocity) const
 {
-    *velocity = Particle::velocity;
+    *velocity = getVelocity();
 }
 
 void Particle::setAngularVelocity(const float &velocity) {
-	Particle::angularVelocity = velocity;
+	store->angularVelocity[index] = velocity;
 }
 
 float Particle::getAngularVelocity() const {
-	return angularVelocity;
+	return store->angularVelocity[index];
 }
 
 void Particle::setAcceleration(const Vector2 &acceleration)
 {
-    Particle::acceleration = acceleration;
+    setAcceleration(acceleration.x, acceleration.y);
 }
 
 void Particle::setAcceleration(const float x, const float y)
 {
-    acceleration.x = x;
-    acceleration.y = y;
+    store->accelerationX[index] = x;
+    store->accelerationY[index] = y;
 }
 
 Vector2 Particle::getAcceleration() const
 {
-    return acceleration;
+    return Vector2(store->accelerationX[index], store->accelerationY[index]);
+}
+
+Vector2 Particle::getLastAcceleration() const
+{
+    return Vector2(store->lastAccelerationX[index], store->lastAccelerationY[index]);
 }
 
 void Particle::setAngularAcceleration(const float &acceleration) {
-	angularAcceleration = acceleration;
+	store->angularAcceleration[index] = acceleration;
 }
 
 float Particle::getAngularAcceleration() const {
-	return angularAcceleration;
+	return store->angularAcceleration[index];
 }
 
 void Particle::setOrientation(const float &orientation) {
-	Particle::orientation = orientation;
+	store->orientation[index] = orientation;
 }
 
 float Particle::getOrientation() const {
-	return orientation;
+	return store->orientation[index];
+}
+
+void Particle::setAwake(const bool awake) {
+	store->awake[index] = awake ? 1 : 0;
+}
+
+bool Particle::isAwake() const {
+	return store->awake[index] != 0;
 }
 
 void Particle::clearAccumulators()
 {
-    forceAccum.clear();
-	torqueAccum = 0;
+    store->forceAccumX[index] = 0;
+    store->forceAccumY[index] = 0;
+	store->torqueAccum[index] = 0;
 }
 
 void Particle::addForce(const Vector2 &force)
 {
-    forceAccum += force;
+    store->forceAccumX[index] += force.x;
+    store->forceAccumY[index] += force.y;
 }
 
 void Particle::addTorque(const float &torque) {
-	torqueAccum += torque;
+	store->torqueAccum[index] += torque;
 }
@@ -1,7 +1,10 @@
 
-#include <float.h>
+#include <math.h>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
 #include <pcontacts.h>
-#include <iostream>
+#include <plog.h>
 
 
 // Contact implementation
@@ -34,6 +37,16 @@ void ParticleContact::resolveVelocity(float duration)
         return;
     }
 
+    // If all particles have infinite mass, then impulses have no effect
+    float impulse;
+    if (!calculateImpulse(separatingVelocity, duration, impulse)) return;
+
+    applyImpulse(impulse);
+    accumulatedImpulse += impulse;
+}
+
+float ParticleContact::calculateTargetVelocity(float separatingVelocity, float duration) const
+{
     // Calculate the new separating velocity
     float newSepVelocity = -separatingVelocity * restitution;
 
@@ -41,9 +54,9 @@ void ParticleContact::resolveVelocity(float duration)
 	// Check velocity build-up due to acceleration only.
 	// (this is to do with better handling resting particles making contact),
 	// Trying to prevent them from "vibrating" and potentially jumping.
-	Vector2 velocityAccel = particle[0]->getAcceleration();
+	Vector2 velocityAccel = particle[0]->getLastAcceleration();
 	// If another particle is involved (i.e. not a collision with the outer scene border)
-	if (particle[1]) velocityAccel -= particle[1]->getAcceleration();
+	if (particle[1]) velocityAccel -= particle[1]->getLastAcceleration();
 	float accCausedSepVel = velocityAccel * contactNormal * duration;
 
 	// If we have a closing velocity due to acceleration build-up,
@@ -53,6 +66,12 @@ void ParticleContact::resolveVelocity(float duration)
 		// Ensure we didn't remove more than we should have.
 		if (newSepVelocity < 0) newSepVelocity = 0;
 	}
+	return newSepVelocity;
+}
+
+bool ParticleContact::calculateImpulse(float separatingVelocity, float duration, float &impulse) const
+{
+    float newSepVelocity = calculateTargetVelocity(separatingVelocity, duration);
 
 	// Doing this we're essentially applying a small change in velocity at each frame
 	// to prevent the increase in velocity that can cause particles to settle in to each other
@@ -65,12 +84,15 @@ void ParticleContact::resolveVelocity(float duration)
     float totalInverseMass = particle[0]->getInverseMass();
     if (particle[1]) totalInverseMass += particle[1]->getInverseMass();
 
-    // If all particles have infinite mass, then impulses have no effect
-    if (totalInverseMass <= 0) return;
+    if (totalInverseMass <= 0) return false;
 
     // Calculate the impulse to apply
-    float impulse = deltaVelocity / totalInverseMass;
+    impulse = deltaVelocity / totalInverseMass;
+    return true;
+}
 
+void ParticleContact::applyImpulse(float impulse)
+{
     // Find the amount of impulse per unit of inverse mass
     Vector2 impulsePerIMass = contactNormal * impulse;
 
@@ -146,7 +168,17 @@ void ParticleContact::resolveInterpenetration(){
 
 ParticleContactResolver::ParticleContactResolver(unsigned iterations)
 :
-iterations(iterations)
+iterations(iterations),
+mode(SOLVE_SEQUENTIAL),
+warmStarting(false),
+iterationsUsed(0),
+iterationBudget(0),
+velocitySweeps(8),
+positionSweeps(3),
+velocityTolerance(1e-3f),
+positionTolerance(1e-2f),
+maxCorrection(0.2f),
+compliance(0)
 {
 }
 
@@ -155,13 +187,290 @@ void ParticleContactResolver::setIterations(unsigned iterations)
     ParticleContactResolver::iterations = iterations;
 }
 
+unsigned ParticleContactResolver::getIterations() const
+{
+    return iterations;
+}
+
+unsigned ParticleContactResolver::getIterationsUsed() const
+{
+    return iterationsUsed;
+}
+
+unsigned ParticleContactResolver::getIterationBudget() const
+{
+    return iterationBudget;
+}
+
+void ParticleContactResolver::setSweeps(unsigned velocitySweeps, unsigned positionSweeps)
+{
+    ParticleContactResolver::velocitySweeps = velocitySweeps;
+    ParticleContactResolver::positionSweeps = positionSweeps;
+}
+
+void ParticleContactResolver::setTolerance(float velocityTolerance, float positionTolerance)
+{
+    ParticleContactResolver::velocityTolerance = velocityTolerance;
+    ParticleContactResolver::positionTolerance = positionTolerance;
+}
+
+void ParticleContactResolver::setMaxCorrection(float maxCorrection)
+{
+    ParticleContactResolver::maxCorrection = maxCorrection;
+}
+
+unsigned ParticleContactResolver::getVelocitySweeps() const
+{
+    return velocitySweeps;
+}
+
+unsigned ParticleContactResolver::getPositionSweeps() const
+{
+    return positionSweeps;
+}
+
+float ParticleContactResolver::getVelocityTolerance() const
+{
+    return velocityTolerance;
+}
+
+float ParticleContactResolver::getPositionTolerance() const
+{
+    return positionTolerance;
+}
+
+float ParticleContactResolver::getMaxCorrection() const
+{
+    return maxCorrection;
+}
+
+void ParticleContactResolver::setCompliance(float compliance)
+{
+    ParticleContactResolver::compliance = compliance;
+}
+
+float ParticleContactResolver::getCompliance() const
+{
+    return compliance;
+}
+
+void ParticleContactResolver::setMode(SolverMode mode)
+{
+    ParticleContactResolver::mode = mode;
+}
+
+ParticleContactResolver::SolverMode ParticleContactResolver::getMode() const
+{
+    return mode;
+}
+
+void ParticleContactResolver::setWarmStarting(bool enabled)
+{
+    warmStarting = enabled;
+}
+
+bool ParticleContactResolver::isWarmStarting() const
+{
+    return warmStarting;
+}
+
+void ParticleContactResolver::buildContactIndex(const ParticleContact *contactArray,
+                                                unsigned numContacts)
+{
+    // Find the highest particle row referenced, to size the index.
+    unsigned particleCount = 0;
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned p = 0; p < 2; p++)
+        {
+            if (!contactArray[i].particle[p]) continue;
+            unsigned row = contactArray[i].particle[p]->getIndex();
+            if (row + 1 > particleCount) particleCount = row + 1;
+        }
+    }
+
+    // Count the contacts touching each particle, then turn the counts in to
+    // start offsets.
+    particleContactStart.assign(particleCount + 1, 0);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        particleContactStart[contactArray[i].particle[0]->getIndex()]++;
+        if (contactArray[i].particle[1]) particleContactStart[contactArray[i].particle[1]->getIndex()]++;
+    }
+
+    unsigned total = 0;
+    for (unsigned p = 0; p <= particleCount; p++)
+    {
+        unsigned count = particleContactStart[p];
+        particleContactStart[p] = total;
+        total += count;
+    }
+
+    // Fill the lists, using each particle's start as its insertion point.
+    particleContacts.resize(total);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned p = 0; p < 2; p++)
+        {
+            if (!contactArray[i].particle[p]) continue;
+            particleContacts[particleContactStart[contactArray[i].particle[p]->getIndex()]++] = i;
+        }
+    }
+    // Filling advanced each start to the end of its list, which is the
+    // next particle's start, so shift them all back by one.
+    for (unsigned p = particleCount; p > 0; p--)
+    {
+        particleContactStart[p] = particleContactStart[p - 1];
+    }
+    particleContactStart[0] = 0;
+}
+
+bool ParticleContactResolver::heapLess(unsigned a, unsigned b) const
+{
+    if (separatingVelocity[a] != separatingVelocity[b])
+    {
+        return separatingVelocity[a] < separatingVelocity[b];
+    }
+    return a < b;
+}
+
+void ParticleContactResolver::heapSwap(unsigned i, unsigned j)
+{
+    unsigned a = heap[i];
+    heap[i] = heap[j];
+    heap[j] = a;
+    heapPosition[heap[i]] = i;
+    heapPosition[heap[j]] = j;
+}
+
+void ParticleContactResolver::heapUp(unsigned i)
+{
+    while (i > 0)
+    {
+        unsigned parent = (i - 1) / 2;
+        if (!heapLess(heap[i], heap[parent])) break;
+        heapSwap(i, parent);
+        i = parent;
+    }
+}
+
+void ParticleContactResolver::heapDown(unsigned i)
+{
+    unsigned size = (unsigned)heap.size();
+    for (;;)
+    {
+        unsigned smallest = i;
+        unsigned left = i * 2 + 1;
+        unsigned right = left + 1;
+        if (left < size && heapLess(heap[left], heap[smallest])) smallest = left;
+        if (right < size && heapLess(heap[right], heap[smallest])) smallest = right;
+        if (smallest == i) break;
+        heapSwap(i, smallest);
+        i = smallest;
+    }
+}
+
+void ParticleContactResolver::heapRemove(unsigned i)
+{
+    unsigned last = (unsigned)heap.size() - 1;
+    heapPosition[heap[i]] = notInHeap;
+    if (i != last)
+    {
+        heap[i] = heap[last];
+        heapPosition[heap[i]] = i;
+        heap.pop_back();
+
+        unsigned moved = heap[i];
+        heapUp(i);
+        heapDown(heapPosition[moved]);
+    }
+    else
+    {
+        heap.pop_back();
+    }
+}
+
+void ParticleContactResolver::updateContact(const ParticleContact *contactArray,
+                                            unsigned index)
+{
+    float sepVel = contactArray[index].calculateSeparatingVelocity();
+    separatingVelocity[index] = sepVel;
+
+    // A contact is worth resolving if it is closing or interpenetrating.
+    // NaN and infinite velocities (of either sign) are left out, since
+    // resolving them would only spread the non-finite values.
+    bool wanted = std::isfinite(sepVel) &&
+        (sepVel < 0 || contactArray[index].penetration > 0);
+
+    unsigned position = heapPosition[index];
+    if (position == notInHeap)
+    {
+        if (!wanted) return;
+        heap.push_back(index);
+        heapPosition[index] = (unsigned)heap.size() - 1;
+        heapUp((unsigned)heap.size() - 1);
+    }
+    else if (!wanted)
+    {
+        heapRemove(position);
+    }
+    else
+    {
+        heapUp(position);
+        heapDown(heapPosition[index]);
+    }
+}
+
+void ParticleContactResolver::updateNeighbours(const ParticleContact *contactArray,
+                                               unsigned index)
+{
+    for (unsigned p = 0; p < 2; p++)
+    {
+        const Particle *particle = contactArray[index].particle[p];
+        if (!particle) continue;
+
+        unsigned row = particle->getIndex();
+        for (unsigned k = particleContactStart[row]; k < particleContactStart[row + 1]; k++)
+        {
+            updateContact(contactArray, particleContacts[k]);
+        }
+    }
+}
+
 void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
                                               unsigned numContacts,
-                                              float duration)
+                                              float duration,
+                                              ThreadPool *pool)
 {
-    unsigned i;
+    // The PGS sweeps start from the accumulated impulses themselves.
+    if (mode == SOLVE_PGS)
+    {
+        resolveContactsPGS(contactArray, numContacts, duration);
+        return;
+    }
 
+    // The greedy modes don't warm start, since they spend their whole
+    // budget on a pile whatever they start from.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        contactArray[i].accumulatedImpulse = 0;
+    }
 
+    iterationBudget = iterations;
+    if (mode == SOLVE_BATCHED)
+    {
+        resolveContactsBatched(contactArray, numContacts, duration, pool);
+    }
+    else
+    {
+        resolveContactsSequential(contactArray, numContacts, duration);
+    }
+}
+
+void ParticleContactResolver::resolveContactsSequential(ParticleContact *contactArray,
+                                                        unsigned numContacts,
+                                                        float duration)
+{
 	/*
 		We apply a limit to the number of iterations (collision resolutions) to prevent the same
 		contacts being resolved over and over again (e.g. for resting objects with similtaneous contacts).
@@ -173,46 +482,556 @@ void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
 		This implementation prioritises the resolution of contacts with the lowest separating velocity first
 	*/
     iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+	/*
+		Order of the algorithm:
+		1. Calculate separating velocity of each contact, keeping the contacts that are closing
+		(or interpenetrating) in a heap ordered by separating velocity.
+
+		2. If the heap is empty, we're done, exit.
+
+		3. Process the collision response algorithm for the contact at the top of the heap
+		(the lowest, most negative, separating velocity).
+
+		4. Resolving a contact only changes the velocities of its particles, so recalculate
+		the separating velocity of just the contacts sharing those particles.
+
+		5. If we still have iterations left return to step 2.
+	*/
+    buildContactIndex(contactArray, numContacts);
+
+    heap.clear();
+    heapPosition.assign(numContacts, notInHeap);
+    separatingVelocity.resize(numContacts);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        updateContact(contactArray, i);
+    }
+
     while(iterationsUsed < iterations)
     {
-		/*
-			Order of the algorithm:
-			1. Calculate separating velocity of each contact, keeping track of the contact with
-			the lowest (most negative value).
+        //Do we have anything worth resolving?
+        if (heap.empty()) break;
+
+        // Resolve the contact with the largest closing velocity
+        unsigned index = heap[0];
+        contactArray[index].resolve(duration);
+
+        // Update the contacts affected by the resolution (including this one).
+        updateNeighbours(contactArray, index);
+
+        iterationsUsed++;
+    }
+	if (iterationsUsed == iterations) PLOG_WARN(PhysicsLog::EVENT_ITERATIONS_EXHAUSTED, "resolver", iterationsUsed);
+
+}
+
+void ParticleContactResolver::colourContacts(const ParticleContact *contactArray,
+                                             unsigned numContacts)
+{
+    // Find the highest particle row referenced, to size the colour masks.
+    unsigned particleCount = 0;
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned p = 0; p < 2; p++)
+        {
+            if (!contactArray[i].particle[p]) continue;
+            unsigned row = contactArray[i].particle[p]->getIndex();
+            if (row + 1 > particleCount) particleCount = row + 1;
+        }
+    }
+    particleColours.assign(particleCount, 0);
+
+    // Greedily give each contact, in order, the lowest colour neither of its
+    // particles has used yet. Contacts with the scenery only have one particle.
+    contactColour.resize(numContacts);
+    batchStart.assign(maxColours + 2, 0);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned long long used = particleColours[contactArray[i].particle[0]->getIndex()];
+        if (contactArray[i].particle[1]) used |= particleColours[contactArray[i].particle[1]->getIndex()];
+
+        unsigned colour = 0;
+        while (colour < maxColours && (used & (1ull << colour))) colour++;
+
+        if (colour < maxColours)
+        {
+            particleColours[contactArray[i].particle[0]->getIndex()] |= 1ull << colour;
+            if (contactArray[i].particle[1]) particleColours[contactArray[i].particle[1]->getIndex()] |= 1ull << colour;
+        }
+
+        // colour == maxColours is the overflow batch.
+        contactColour[i] = colour;
+        batchStart[colour + 1]++;
+    }
+
+    // Counting sort the contacts by colour, keeping them in order within a colour.
+    for (unsigned c = 0; c <= maxColours; c++)
+    {
+        batchStart[c + 1] += batchStart[c];
+    }
+    batchContacts.resize(numContacts);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        batchContacts[batchStart[contactColour[i]]++] = i;
+    }
+    for (unsigned c = maxColours + 1; c > 0; c--)
+    {
+        batchStart[c] = batchStart[c - 1];
+    }
+    batchStart[0] = 0;
+}
+
+void ParticleContactResolver::resolveContactsBatched(ParticleContact *contactArray,
+                                                     unsigned numContacts,
+                                                     float duration,
+                                                     ThreadPool *pool)
+{
+    iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    colourContacts(contactArray, numContacts);
+
+    // Contacts per task, large enough to be worth handing to another thread.
+    const unsigned grainSize = 256;
+
+    std::atomic<unsigned> resolved(0);
+    bool anyResolved = true;
+    while (anyResolved && iterationsUsed < iterations)
+    {
+        anyResolved = false;
+
+        for (unsigned c = 0; c <= maxColours && iterationsUsed < iterations; c++)
+        {
+            // Visit no more contacts than there are iterations left, so the
+            // batch can't resolve past the budget.
+            unsigned first = batchStart[c];
+            unsigned count = std::min(batchStart[c + 1] - first, iterations - iterationsUsed);
+            if (count == 0) continue;
+
+            // Resolve every contact in the batch that is closing or
+            // interpenetrating. None of them share a particle, so the order
+            // doesn't matter.
+            ThreadPool::Task task = [this, contactArray, first, duration, &resolved](unsigned begin, unsigned end, unsigned)
+            {
+                unsigned count = 0;
+                for (unsigned b = first + begin; b < first + end; b++)
+                {
+                    ParticleContact &contact = contactArray[batchContacts[b]];
+                    float sepVel = contact.calculateSeparatingVelocity();
+                    if (sepVel < 0 || contact.penetration > 0)
+                    {
+                        contact.resolve(duration);
+                        count++;
+                    }
+                }
+                resolved += count;
+            };
+
+            resolved = 0;
+            // The overflow batch may share particles, so keep it on one thread.
+            if (pool && c < maxColours) pool->parallelFor(count, grainSize, task);
+            else task(0, count, 0);
+
+            iterationsUsed += resolved;
+            if (resolved > 0) anyResolved = true;
+        }
+    }
+	if (iterationsUsed >= iterations) PLOG_WARN(PhysicsLog::EVENT_ITERATIONS_EXHAUSTED, "resolver", iterationsUsed);
+}
+
+void ParticleContactResolver::resolveContactsPGS(ParticleContact *contactArray,
+                                                 unsigned numContacts,
+                                                 float duration)
+{
+    iterationsUsed = 0;
+    iterationBudget = (velocitySweeps + positionSweeps) * numContacts;
+    if (numContacts == 0) return;
+
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    std::vector<float> &velocityX = store.velocityX;
+    std::vector<float> &velocityY = store.velocityY;
+    const std::vector<float> &inverseMass = store.inverseMass;
+
+    constraintFirst.resize(numContacts);
+    constraintSecond.resize(numContacts);
+    constraintNormalX.resize(numContacts);
+    constraintNormalY.resize(numContacts);
+    constraintMass.resize(numContacts);
+    constraintTarget.resize(numContacts);
+    constraintImpulse.resize(numContacts);
+    constraintPenetration.resize(numContacts);
+
+    /*
+        Copy what the sweeps need out of the contacts in to flat arrays, so
+        each sweep streams through them in order. The target separating
+        velocity is worked out from the velocity before any impulse is
+        applied, as the other modes do when they first resolve a contact.
+    */
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        ParticleContact &contact = contactArray[i];
+        unsigned first = contact.particle[0]->getIndex();
+        unsigned second = contact.particle[1] ? contact.particle[1]->getIndex() : ~0u;
+
+        float totalInverseMass = inverseMass[first];
+        if (second != ~0u) totalInverseMass += inverseMass[second];
+
+        float separatingVelocity = contact.calculateSeparatingVelocity();
 
-			2. If lowest sepVel >= 0 , we're done, exit.
+        constraintFirst[i] = first;
+        constraintSecond[i] = second;
+        constraintNormalX[i] = contact.contactNormal.x;
+        constraintNormalY[i] = contact.contactNormal.y;
+        constraintMass[i] = totalInverseMass > 0 ? 1.0f / totalInverseMass : 0;
+        constraintTarget[i] = separatingVelocity < 0 ? contact.calculateTargetVelocity(separatingVelocity, duration) : 0;
+        constraintPenetration[i] = contact.penetration;
+        constraintImpulse[i] = 0;
+
+        // The contacts the other modes would resolve reverse the spin of
+        // their particles; do the same, once per contact.
+        if (separatingVelocity < 0 || contact.penetration > 0)
+        {
+            contact.resolveAngularVelocity(duration);
+        }
+    }
 
-			3. Process the collision response algorithm for contact with lowest sepVel
+    // Start from last step's impulses, which the sweeps can take back.
+    if (warmStarting)
+    {
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            float impulse = contactArray[i].accumulatedImpulse;
+            if (!(impulse > 0) || constraintMass[i] <= 0) continue;
 
-			4. If we still have iterations left return to step 1.
-		*/
+            unsigned first = constraintFirst[i];
+            unsigned second = constraintSecond[i];
+            float impulseX = constraintNormalX[i] * impulse;
+            float impulseY = constraintNormalY[i] * impulse;
+            velocityX[first] += impulseX * inverseMass[first];
+            velocityY[first] += impulseY * inverseMass[first];
+            if (second != ~0u)
+            {
+                velocityX[second] -= impulseX * inverseMass[second];
+                velocityY[second] -= impulseY * inverseMass[second];
+            }
+            constraintImpulse[i] = impulse;
+        }
+    }
 
-        // Find the contact with the largest closing velocity (speed);
-        float max = DBL_MAX;
-        unsigned maxIndex = numContacts;
-        for (i = 0; i < numContacts; i++)
+    bool converged = false;
+    for (unsigned sweep = 0; sweep < velocitySweeps && !converged; sweep++)
+    {
+        float largestChange = 0;
+        for (unsigned i = 0; i < numContacts; i++)
         {
-			// Get the separating velocity of this contact
-            float sepVel = contactArray[i].calculateSeparatingVelocity();
-            // If separating velocity is less than the maximum separating velocity,
-			// and the separating velocity is less than 0 or penetration > 0
-			if (sepVel < max &&
-                (sepVel < 0 || contactArray[i].penetration > 0))
+            unsigned first = constraintFirst[i];
+            unsigned second = constraintSecond[i];
+            float normalX = constraintNormalX[i];
+            float normalY = constraintNormalY[i];
+
+            float relativeX = velocityX[first];
+            float relativeY = velocityY[first];
+            if (second != ~0u)
             {
-				// Store this separating velocity and the index of the contact
-				// in the array.
-                max = sepVel;
-                maxIndex = i;
+                relativeX -= velocityX[second];
+                relativeY -= velocityY[second];
             }
+            float separatingVelocity = relativeX * normalX + relativeY * normalY;
+
+            // Clamp the total, not the change, so the contact only ever
+            // pushes but can give back what earlier sweeps over-applied.
+            float impulse = (constraintTarget[i] - separatingVelocity) * constraintMass[i];
+            float accumulated = constraintImpulse[i] + impulse;
+            if (accumulated < 0) accumulated = 0;
+            impulse = accumulated - constraintImpulse[i];
+            constraintImpulse[i] = accumulated;
+
+            float impulseX = normalX * impulse;
+            float impulseY = normalY * impulse;
+            velocityX[first] += impulseX * inverseMass[first];
+            velocityY[first] += impulseY * inverseMass[first];
+            if (second != ~0u)
+            {
+                velocityX[second] -= impulseX * inverseMass[second];
+                velocityY[second] -= impulseY * inverseMass[second];
+            }
+
+            float change = constraintMass[i] > 0 ? fabsf(impulse) / constraintMass[i] : 0;
+            if (change > largestChange) largestChange = change;
         }
-         //Do we have anything worth resolving?
-        if (maxIndex == numContacts) break;
+        iterationsUsed += numContacts;
 
-        // Resolve this contact
-        contactArray[maxIndex].resolve(duration);
+        converged = largestChange <= velocityTolerance;
+    }
+	if (!converged && velocitySweeps > 0) PLOG_WARN(PhysicsLog::EVENT_ITERATIONS_EXHAUSTED, "resolver", iterationsUsed);
 
-        iterationsUsed++;
+    /*
+        Push the particles apart along the contact normals, sweeping the
+        same way, until no contact penetrates by more than the tolerance.
+        The penetration left at a contact is its starting
+        penetration less how far its particles have moved apart along its
+        normal, so the moves are kept per particle and only written to the
+        positions at the end.
+    */
+    moveX.resize(store.size());
+    moveY.resize(store.size());
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        moveX[constraintFirst[i]] = moveY[constraintFirst[i]] = 0;
+        if (constraintSecond[i] != ~0u) moveX[constraintSecond[i]] = moveY[constraintSecond[i]] = 0;
     }
-	if (iterationsUsed == iterations) std::cout << "Resolver: All iterations used." << std::endl;
 
-}
\ No newline at end of file
+    for (unsigned sweep = 0; sweep < positionSweeps; sweep++)
+    {
+        float largestExcess = 0;
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            unsigned first = constraintFirst[i];
+            unsigned second = constraintSecond[i];
+            float normalX = constraintNormalX[i];
+            float normalY = constraintNormalY[i];
+
+            float movedX = moveX[first];
+            float movedY = moveY[first];
+            if (second != ~0u)
+            {
+                movedX -= moveX[second];
+                movedY -= moveY[second];
+            }
+            // Leave the contact penetrating by the tolerance, so it is
+            // still reported next step and the velocity sweeps hold it.
+            float excess = constraintPenetration[i] - (movedX * normalX + movedY * normalY) - positionTolerance;
+            if (excess <= 0) continue;
+            if (excess > largestExcess) largestExcess = excess;
+            if (excess > maxCorrection) excess = maxCorrection;
+
+            float move = excess * constraintMass[i];
+            moveX[first] += normalX * move * inverseMass[first];
+            moveY[first] += normalY * move * inverseMass[first];
+            if (second != ~0u)
+            {
+                moveX[second] -= normalX * move * inverseMass[second];
+                moveY[second] -= normalY * move * inverseMass[second];
+            }
+        }
+        iterationsUsed += numContacts;
+
+        if (largestExcess <= 0) break;
+    }
+
+    // Write the moves and what is left of each contact back.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned first = constraintFirst[i];
+        unsigned second = constraintSecond[i];
+
+        float movedX = moveX[first];
+        float movedY = moveY[first];
+        if (second != ~0u)
+        {
+            movedX -= moveX[second];
+            movedY -= moveY[second];
+        }
+        float penetration = constraintPenetration[i] - (movedX * constraintNormalX[i] + movedY * constraintNormalY[i]);
+
+        contactArray[i].penetration = penetration > 0 ? penetration : 0;
+        contactArray[i].accumulatedImpulse = constraintImpulse[i];
+    }
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned rows[2] = { constraintFirst[i], constraintSecond[i] };
+        for (unsigned p = 0; p < 2; p++)
+        {
+            unsigned row = rows[p];
+            if (row == ~0u) continue;
+            store.positionX[row] += moveX[row];
+            store.positionY[row] += moveY[row];
+            // Only move each particle once.
+            moveX[row] = moveY[row] = 0;
+        }
+    }
+}
+
+void ParticleContactResolver::beginSubsteps(ParticleContact *contactArray,
+                                            unsigned numContacts,
+                                            float duration)
+{
+    iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    const ParticleStore &store = *contactArray[0].particle[0]->getStore();
+
+    constraintFirst.resize(numContacts);
+    constraintSecond.resize(numContacts);
+    constraintNormalX.resize(numContacts);
+    constraintNormalY.resize(numContacts);
+    constraintOffset.resize(numContacts);
+    constraintRestitution.resize(numContacts);
+    constraintVelocity.resize(numContacts);
+
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        ParticleContact &contact = contactArray[i];
+        unsigned first = contact.particle[0]->getIndex();
+        unsigned second = contact.particle[1] ? contact.particle[1]->getIndex() : ~0u;
+        float normalX = contact.contactNormal.x;
+        float normalY = contact.contactNormal.y;
+
+        float separation = store.positionX[first] * normalX + store.positionY[first] * normalY;
+        if (second != ~0u) separation -= store.positionX[second] * normalX + store.positionY[second] * normalY;
+
+        float separatingVelocity = contact.calculateSeparatingVelocity();
+
+        constraintFirst[i] = first;
+        constraintSecond[i] = second;
+        constraintNormalX[i] = normalX;
+        constraintNormalY[i] = normalY;
+        constraintOffset[i] = contact.penetration + separation;
+        constraintRestitution[i] = contact.restitution;
+        constraintVelocity[i] = separatingVelocity;
+
+        // Contacts found ahead of time only count once they would close
+        // within the frame.
+        if (contact.penetration > 0 || contact.penetration - separatingVelocity * duration > 0)
+        {
+            contact.resolveAngularVelocity(duration);
+        }
+    }
+}
+
+void ParticleContactResolver::projectContacts(ParticleContact *contactArray,
+                                              unsigned numContacts,
+                                              float substep)
+{
+    if (numContacts == 0) return;
+
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    std::vector<float> &positionX = store.positionX;
+    std::vector<float> &positionY = store.positionY;
+    std::vector<float> &velocityX = store.velocityX;
+    std::vector<float> &velocityY = store.velocityY;
+    const std::vector<float> &inverseMass = store.inverseMass;
+
+    constraintActive.resize(numContacts);
+
+    // XPBD scales the compliance by the square of the substep.
+    float scaledCompliance = compliance / (substep * substep);
+
+    /*
+        Push apart the particles of every contact still penetrating, moving
+        their velocities along with them, so each particle's velocity
+        changes by how far the whole pass moved it.
+    */
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned first = constraintFirst[i];
+        unsigned second = constraintSecond[i];
+        float normalX = constraintNormalX[i];
+        float normalY = constraintNormalY[i];
+
+        float separation = positionX[first] * normalX + positionY[first] * normalY;
+        float firstInverseMass = inverseMass[first];
+        float secondInverseMass = 0;
+        if (second != ~0u)
+        {
+            separation -= positionX[second] * normalX + positionY[second] * normalY;
+            secondInverseMass = inverseMass[second];
+        }
+
+        // Keep the penetration up to date, so once the substeps are done
+        // contacts that never closed are left with a negative one.
+        contactArray[i].penetration = constraintOffset[i] - separation;
+
+        // As in the PGS mode, leave the contact penetrating by the
+        // tolerance so it is still reported next frame.
+        float excess = constraintOffset[i] - separation - positionTolerance;
+        float totalInverseMass = firstInverseMass + secondInverseMass;
+        constraintActive[i] = excess > 0 && totalInverseMass > 0;
+        if (!constraintActive[i]) continue;
+
+        float move = excess / (totalInverseMass + scaledCompliance);
+        float moveX = normalX * move;
+        float moveY = normalY * move;
+        positionX[first] += moveX * firstInverseMass;
+        positionY[first] += moveY * firstInverseMass;
+        velocityX[first] += moveX * firstInverseMass / substep;
+        velocityY[first] += moveY * firstInverseMass / substep;
+        if (second != ~0u)
+        {
+            positionX[second] -= moveX * secondInverseMass;
+            positionY[second] -= moveY * secondInverseMass;
+            velocityX[second] -= moveX * secondInverseMass / substep;
+            velocityY[second] -= moveY * secondInverseMass / substep;
+        }
+    }
+
+    /*
+        Then set the separating velocity of each contact pushed on: bouncing
+        by its restitution if it was closing when the substep began, or 0.
+        Contacts closing no faster than a couple of substeps of acceleration
+        would close them are resting, and bouncing those would only make
+        them jitter.
+    */
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned first = constraintFirst[i];
+        unsigned second = constraintSecond[i];
+        float normalX = constraintNormalX[i];
+        float normalY = constraintNormalY[i];
+
+        float relativeX = velocityX[first];
+        float relativeY = velocityY[first];
+        if (second != ~0u)
+        {
+            relativeX -= velocityX[second];
+            relativeY -= velocityY[second];
+        }
+        float separatingVelocity = relativeX * normalX + relativeY * normalY;
+        float closingVelocity = constraintVelocity[i];
+        constraintVelocity[i] = separatingVelocity;
+        if (!constraintActive[i]) continue;
+
+        float firstInverseMass = inverseMass[first];
+        float secondInverseMass = 0;
+        float relativeAccX = store.lastAccelerationX[first];
+        float relativeAccY = store.lastAccelerationY[first];
+        if (second != ~0u)
+        {
+            secondInverseMass = inverseMass[second];
+            relativeAccX -= store.lastAccelerationX[second];
+            relativeAccY -= store.lastAccelerationY[second];
+        }
+
+        float restingVelocity = 2 * substep * fabsf(relativeAccX * normalX + relativeAccY * normalY);
+        float targetVelocity = closingVelocity < -restingVelocity ? -closingVelocity * constraintRestitution[i] : 0;
+
+        float impulse = (targetVelocity - separatingVelocity) / (firstInverseMass + secondInverseMass);
+        velocityX[first] += normalX * impulse * firstInverseMass;
+        velocityY[first] += normalY * impulse * firstInverseMass;
+        if (second != ~0u)
+        {
+            velocityX[second] -= normalX * impulse * secondInverseMass;
+            velocityY[second] -= normalY * impulse * secondInverseMass;
+        }
+        constraintVelocity[i] = targetVelocity;
+    }
+    iterationsUsed += numContacts;
+}
+
+unsigned ParticleContactGenerator::getPartCount() const
+{
+    return 1;
+}
+
+void ParticleContactGenerator::prepareParts() const
+{
+}
+
+unsigned ParticleContactGenerator::addPartContact(ParticleContact *contact,
+                                                  unsigned limit,
+                                                  unsigned) const
+{
+    return addContact(contact, limit);
+}
@@ -0,0 +1,217 @@
+#include <pfgen.h>
+#include <math.h>
+#include <algorithm>
+
+// Returns true if the particle in the row is moved by forces.
+static inline bool isMoving(const ParticleStore &store, unsigned row)
+{
+	return store.inverseMass[row] > 0.0f && store.awake[row];
+}
+
+ParticleGravity::ParticleGravity(const Vector2 &gravity)
+:
+gravity(gravity)
+{
+}
+
+void ParticleGravity::updateForces(ParticleStore &store, unsigned begin, unsigned end, float /* duration */)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		if (!isMoving(store, i)) continue;
+
+		// Scale by the mass, so every particle gets the same acceleration.
+		float mass = 1.0f / store.inverseMass[i];
+		store.forceAccumX[i] += gravity.x * mass;
+		store.forceAccumY[i] += gravity.y * mass;
+	}
+}
+
+void ParticleGravity::setGravity(const Vector2 &gravity)
+{
+	ParticleGravity::gravity = gravity;
+}
+
+const Vector2& ParticleGravity::getGravity() const
+{
+	return gravity;
+}
+
+ParticleDrag::ParticleDrag(float k1, float k2)
+:
+k1(k1),
+k2(k2)
+{
+}
+
+void ParticleDrag::updateForces(ParticleStore &store, unsigned begin, unsigned end, float /* duration */)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		if (!isMoving(store, i)) continue;
+
+		float velocityX = store.velocityX[i];
+		float velocityY = store.velocityY[i];
+		float speed = sqrtf(velocityX * velocityX + velocityY * velocityY);
+
+		// The force along the velocity is (k1 * speed + k2 * speed^2) / speed
+		// times the velocity, which needs no division.
+		float drag = k1 + k2 * speed;
+		store.forceAccumX[i] -= velocityX * drag;
+		store.forceAccumY[i] -= velocityY * drag;
+	}
+}
+
+ParticleWind::ParticleWind(const Vector2 &velocity, float coefficient)
+:
+velocity(velocity),
+coefficient(coefficient)
+{
+}
+
+void ParticleWind::updateForces(ParticleStore &store, unsigned begin, unsigned end, float /* duration */)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		if (!isMoving(store, i)) continue;
+
+		store.forceAccumX[i] += (velocity.x - store.velocityX[i]) * coefficient;
+		store.forceAccumY[i] += (velocity.y - store.velocityY[i]) * coefficient;
+	}
+}
+
+void ParticleWind::setVelocity(const Vector2 &velocity)
+{
+	ParticleWind::velocity = velocity;
+}
+
+const Vector2& ParticleWind::getVelocity() const
+{
+	return velocity;
+}
+
+ParticleAnchoredSpring::ParticleAnchoredSpring(const Vector2 &anchor, float springConstant, float restLength)
+:
+anchor(anchor),
+springConstant(springConstant),
+restLength(restLength)
+{
+}
+
+void ParticleAnchoredSpring::updateForces(ParticleStore &store, unsigned begin, unsigned end, float /* duration */)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		if (!isMoving(store, i)) continue;
+
+		float offsetX = store.positionX[i] - anchor.x;
+		float offsetY = store.positionY[i] - anchor.y;
+		float length = sqrtf(offsetX * offsetX + offsetY * offsetY);
+
+		// A particle sitting on the anchor has no direction to be pushed in.
+		if (length <= 0.0f) continue;
+
+		float scale = -springConstant * (length - restLength) / length;
+		store.forceAccumX[i] += offsetX * scale;
+		store.forceAccumY[i] += offsetY * scale;
+	}
+}
+
+void ParticleAnchoredSpring::setAnchor(const Vector2 &anchor)
+{
+	ParticleAnchoredSpring::anchor = anchor;
+}
+
+const Vector2& ParticleAnchoredSpring::getAnchor() const
+{
+	return anchor;
+}
+
+ParticleAttractor::ParticleAttractor(const Vector2 &centre, float strength, float minDistance)
+:
+centre(centre),
+strength(strength),
+minDistance(minDistance)
+{
+}
+
+void ParticleAttractor::updateForces(ParticleStore &store, unsigned begin, unsigned end, float /* duration */)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		if (!isMoving(store, i)) continue;
+
+		float offsetX = centre.x - store.positionX[i];
+		float offsetY = centre.y - store.positionY[i];
+		float distance = sqrtf(offsetX * offsetX + offsetY * offsetY);
+		if (distance <= 0.0f) continue;
+
+		// strength / distance^2 along the unit offset, times the mass.
+		float clamped = distance > minDistance ? distance : minDistance;
+		float scale = strength / (clamped * clamped * distance * store.inverseMass[i]);
+		store.forceAccumX[i] += offsetX * scale;
+		store.forceAccumY[i] += offsetY * scale;
+	}
+}
+
+void ParticleAttractor::setCentre(const Vector2 &centre)
+{
+	ParticleAttractor::centre = centre;
+}
+
+const Vector2& ParticleAttractor::getCentre() const
+{
+	return centre;
+}
+
+void ParticleForceRegistry::add(ParticleForceGenerator *generator, unsigned first, unsigned count)
+{
+	Registration registration;
+	registration.generator = generator;
+	registration.first = first;
+	registration.count = count;
+	registrations.push_back(registration);
+}
+
+void ParticleForceRegistry::remove(ParticleForceGenerator *generator)
+{
+	std::vector<Registration>::iterator last = std::remove_if(registrations.begin(), registrations.end(),
+		[generator](const Registration &registration) { return registration.generator == generator; });
+	registrations.erase(last, registrations.end());
+}
+
+void ParticleForceRegistry::clear()
+{
+	registrations.clear();
+}
+
+unsigned ParticleForceRegistry::size() const
+{
+	return (unsigned)registrations.size();
+}
+
+void ParticleForceRegistry::updateForces(ParticleStore &store, float duration, ThreadPool *pool)
+{
+	// The same chunking as integration, so each chunk is worth handing out.
+	const unsigned grainSize = 4096;
+
+	for (std::vector<Registration>::iterator r = registrations.begin(); r != registrations.end(); r++)
+	{
+		if (r->first >= store.size()) continue;
+		unsigned count = std::min(r->count, store.size() - r->first);
+		ParticleForceGenerator *generator = r->generator;
+		unsigned first = r->first;
+
+		if (!pool || count <= grainSize)
+		{
+			generator->updateForces(store, first, first + count, duration);
+			continue;
+		}
+
+		pool->parallelFor(count, grainSize,
+			[&store, generator, first, duration](unsigned begin, unsigned end, unsigned)
+			{
+				generator->updateForces(store, first + begin, first + end, duration);
+			});
+	}
+}
@@ -0,0 +1,109 @@
+#include <physicsthread.h>
+#include <chrono>
+
+PhysicsThread::PhysicsThread(ParticleWorld *world, FixedTimestep *timestep)
+:
+world(world),
+timestep(timestep),
+running(false),
+stopping(false),
+stepCount(0)
+{
+}
+
+PhysicsThread::~PhysicsThread()
+{
+	stop();
+}
+
+void PhysicsThread::start()
+{
+	if (running) return;
+
+	// Give the reader something to draw before the first step.
+	publishSnapshot();
+
+	stopping = false;
+	running = true;
+	thread = std::thread(&PhysicsThread::run, this);
+}
+
+void PhysicsThread::stop()
+{
+	if (!running) return;
+
+	stopping = true;
+	thread.join();
+	running = false;
+}
+
+bool PhysicsThread::isRunning() const
+{
+	return running;
+}
+
+const ParticleSnapshot& PhysicsThread::acquireSnapshot()
+{
+	return snapshots.acquire();
+}
+
+unsigned long PhysicsThread::getStepCount() const
+{
+	return stepCount;
+}
+
+void PhysicsThread::run()
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point last = Clock::now();
+
+	while (!stopping)
+	{
+		Clock::time_point now = Clock::now();
+		float elapsed = std::chrono::duration<float>(now - last).count();
+		last = now;
+
+		unsigned steps = timestep->advance(elapsed);
+		if (steps > 0)
+		{
+			stepCount += steps;
+			publishSnapshot();
+		}
+
+		// Sleep until the accumulator will hold the next whole step.
+		float wait = (1.0f - timestep->getInterpolation()) * timestep->getStepDuration();
+		std::this_thread::sleep_for(std::chrono::duration<float>(wait));
+	}
+}
+
+void PhysicsThread::publishSnapshot()
+{
+	ParticleSnapshot &snapshot = snapshots.getBack();
+	ParticleStore &store = world->getStore();
+	unsigned count = store.size();
+
+	snapshot.previousX.resize(count);
+	snapshot.previousY.resize(count);
+	snapshot.previousOrientation.resize(count);
+
+	// The reader interpolates between the last two steps for the time it
+	// draws at, so motion is smooth whatever the step rate.
+	for (unsigned i = 0; i < count; i++)
+	{
+		Vector2 previous = timestep->getPreviousPosition(i);
+		snapshot.previousX[i] = previous.x;
+		snapshot.previousY[i] = previous.y;
+		snapshot.previousOrientation[i] = timestep->getPreviousOrientation(i);
+	}
+	snapshot.positionX = store.positionX;
+	snapshot.positionY = store.positionY;
+	snapshot.orientation = store.orientation;
+	snapshot.radius = store.radius;
+	snapshot.step = stepCount;
+
+	snapshot.time = ParticleSnapshot::Clock::now();
+	snapshot.stepDuration = timestep->getStepDuration();
+	snapshot.interpolation = timestep->getInterpolation();
+
+	snapshots.publish();
+}
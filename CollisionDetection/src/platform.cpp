@@ -0,0 +1,97 @@
+#include <platform.h>
+#include <math.h>
+#include <plog.h>
+
+Platform::Platform()
+:
+particles(0),
+numParticles(0)
+{
+}
+
+unsigned Platform::addContact(ParticleContact *contact, 
+                              unsigned limit) const
+{
+    
+	const static float restitution = 0.8f;
+	//const static float restitution = 1.0f;
+	unsigned used = 0;
+    
+	for (unsigned i = 0; i < numParticles; i++){
+		if (used >= limit) {
+			PLOG_INFO(PhysicsLog::EVENT_CONTACT_LIMIT, "platform", used);
+			break;
+		}
+
+		// Sleeping blobs haven't moved since they last rested here.
+		if (!particles[i].isAwake()) continue;
+
+		// Check for penetration
+		// Get distance to particle from start point
+		Vector2 toParticle = particles[i].getPosition() - start;
+		Vector2 lineDirection = end - start;
+
+		// Get projected distance from distance to particle multiplied
+		// by the direction of the line
+		float projected = toParticle * lineDirection;
+		float platformSqLength = lineDirection.squareMagnitude();
+		// Get the squared radius of the particle to aviod using square root in calculations
+		float squareRadius = particles[i].getRadius()*particles[i].getRadius();
+
+		if (projected <= 0)
+		{
+			// The blob is nearest to the start point
+			if (toParticle.squareMagnitude() < squareRadius)
+			{
+				// We have a collision, populate the contact structure accordingly.
+				contact->contactNormal = toParticle.unit();
+				contact->restitution = restitution;
+				contact->particle[0] = particles + i;
+				contact->particle[1] = 0;
+				contact->penetration = particles[i].getRadius() - toParticle.magnitude();
+				used++;
+				contact++;
+			}
+
+		}
+		else if (projected >= platformSqLength)
+		{
+
+			// Update particle position with respect to the end point of the platform
+			toParticle = particles[i].getPosition() - end;
+			
+			// The blob is nearest to the end point
+			if (toParticle.squareMagnitude() < squareRadius)
+			{
+				// We have a collision, populate the contact structure accordingly.
+				contact->contactNormal = toParticle.unit();
+				contact->restitution = restitution;
+				contact->particle[0] = particles + i;
+				contact->particle[1] = 0;
+				contact->penetration = particles[i].getRadius() - toParticle.magnitude();
+				used++;
+				contact++;
+			}
+		}
+		else
+		{
+			// the blob is between the start and end points.
+			float distanceToPlatform = toParticle.squareMagnitude() - projected*projected / platformSqLength;
+			if (distanceToPlatform < squareRadius)
+			{
+				// We have a collision, populate the contact structure accordingly.
+				Vector2 closestPoint = start + lineDirection*(projected / platformSqLength);
+
+				contact->contactNormal = (particles[i].getPosition() - closestPoint).unit();
+				contact->restitution = restitution;
+				contact->particle[0] = particles + i;
+				contact->particle[1] = 0;
+				contact->penetration = particles[i].getRadius() - sqrt(distanceToPlatform);
+				used++;
+				contact++;
+			}
+		}
+	}
+
+    return used;
+}
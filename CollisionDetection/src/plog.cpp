@@ -0,0 +1,140 @@
+#include <plog.h>
+
+/*
+	A bounded queue with a sequence number in each slot.  A slot is free for
+	the writer claiming position pos when its sequence is pos, and holds a
+	finished record for the reader when its sequence is pos + 1.  Writers claim
+	positions with a compare-and-swap on the tail, so several threads can log
+	at once without a lock.
+*/
+struct LogSlot
+{
+	std::atomic<unsigned> sequence;
+	PhysicsLog::Record record;
+};
+
+struct LogBuffer
+{
+	LogSlot slots[PhysicsLog::capacity];
+	std::atomic<unsigned> tail;
+	unsigned head;
+
+	std::atomic<unsigned long long> counts[PhysicsLog::EVENT_COUNT];
+	std::atomic<unsigned long long> dropped;
+
+	LogBuffer()
+	:
+	tail(0),
+	head(0),
+	dropped(0)
+	{
+		for (unsigned i = 0; i < PhysicsLog::capacity; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+		for (unsigned e = 0; e < PhysicsLog::EVENT_COUNT; e++) counts[e].store(0, std::memory_order_relaxed);
+	}
+};
+
+static LogBuffer& logBuffer()
+{
+	static LogBuffer buffer;
+	return buffer;
+}
+
+void PhysicsLog::record(Level level, Event event, const char *source, unsigned value)
+{
+	count(event);
+
+	LogBuffer &buffer = logBuffer();
+	unsigned pos = buffer.tail.load(std::memory_order_relaxed);
+	LogSlot *slot;
+	for (;;)
+	{
+		slot = &buffer.slots[pos % capacity];
+		int difference = (int)(slot->sequence.load(std::memory_order_acquire) - pos);
+
+		if (difference == 0)
+		{
+			// The slot is free, try to claim it.
+			if (buffer.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (difference < 0)
+		{
+			// The reader hasn't freed this slot yet, so the buffer is full.
+			buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			// Another writer took it first.
+			pos = buffer.tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->record.level = level;
+	slot->record.event = event;
+	slot->record.source = source;
+	slot->record.value = value;
+	slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void PhysicsLog::count(Event event)
+{
+	logBuffer().counts[event].fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned PhysicsLog::drain(Record *records, unsigned maxRecords)
+{
+	LogBuffer &buffer = logBuffer();
+
+	unsigned drained = 0;
+	while (drained < maxRecords)
+	{
+		LogSlot &slot = buffer.slots[buffer.head % capacity];
+		if (slot.sequence.load(std::memory_order_acquire) != buffer.head + 1) break;
+
+		records[drained++] = slot.record;
+
+		// Hand the slot back to the writers for the next lap.
+		slot.sequence.store(buffer.head + capacity, std::memory_order_release);
+		buffer.head++;
+	}
+	return drained;
+}
+
+unsigned long long PhysicsLog::getCount(Event event)
+{
+	return logBuffer().counts[event].load(std::memory_order_relaxed);
+}
+
+unsigned long long PhysicsLog::getDropped()
+{
+	return logBuffer().dropped.load(std::memory_order_relaxed);
+}
+
+void PhysicsLog::resetCounts()
+{
+	LogBuffer &buffer = logBuffer();
+	for (unsigned e = 0; e < EVENT_COUNT; e++) buffer.counts[e].store(0, std::memory_order_relaxed);
+	buffer.dropped.store(0, std::memory_order_relaxed);
+}
+
+const char* PhysicsLog::getEventName(Event event)
+{
+	switch (event)
+	{
+	case EVENT_CONTACT_LIMIT: return "contact limit used";
+	case EVENT_ITERATIONS_EXHAUSTED: return "all iterations used";
+	default: return "unknown event";
+	}
+}
+
+const char* PhysicsLog::getLevelName(Level level)
+{
+	switch (level)
+	{
+	case LEVEL_ERROR: return "error";
+	case LEVEL_WARN: return "warning";
+	case LEVEL_INFO: return "info";
+	case LEVEL_DEBUG: return "debug";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,490 @@
+#include <pstore.h>
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+
+// The vector integration paths are only available on x86 processors.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define PSTORE_X86
+#include <intrin.h>
+#include <immintrin.h>
+// MSVC allows any intrinsic to be used without enabling it for the whole file.
+#define TARGET_SSE2
+#define TARGET_AVX
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PSTORE_X86
+#include <immintrin.h>
+// Compile just the vector kernels for their instruction set, the rest of the
+// file stays runnable on any processor.
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+
+namespace {
+
+	/*
+		Caches pow(damping, duration) for the last few damping values seen.
+		Particles overwhelmingly share a handful of damping values, so this
+		replaces a pow call per particle with one per distinct value per step.
+	*/
+	struct DragCache
+	{
+		enum { size = 4 };
+
+		float duration;
+		// The most recently used damping value and its factor, checked first.
+		float damping;
+		float factor;
+
+		float dampings[size];
+		float factors[size];
+		unsigned next;
+
+		DragCache(float duration, float firstDamping)
+		:
+		duration(duration),
+		damping(firstDamping),
+		factor(pow(firstDamping, duration)),
+		next(1)
+		{
+			for (unsigned i = 0; i < size; i++)
+			{
+				dampings[i] = damping;
+				factors[i] = factor;
+			}
+		}
+
+		float get(float value)
+		{
+			if (value == damping) return factor;
+
+			for (unsigned i = 0; i < size; i++)
+			{
+				if (dampings[i] == value)
+				{
+					damping = value;
+					factor = factors[i];
+					return factor;
+				}
+			}
+
+			// Not cached, replace the oldest entry.
+			damping = value;
+			factor = pow(value, duration);
+			dampings[next] = damping;
+			factors[next] = factor;
+			next = (next + 1) % size;
+			return factor;
+		}
+	};
+
+	// Integrates a single row of the store, used by every path for leftover particles.
+	inline void integrateRow(ParticleStore &s, unsigned i, float duration,
+		DragCache &linearDrag, DragCache &angularDrag)
+	{
+		// We don't integrate things with zero mass, or that are asleep.
+		if (s.inverseMass[i] <= 0.0f || !s.awake[i]) return;
+
+		// update position based on linear velocity
+		s.positionX[i] += s.velocityX[i] * duration;
+		s.positionY[i] += s.velocityY[i] * duration;
+		// update orientation based on angular velocity
+		s.orientation[i] += s.angularVelocity[i] * duration;
+
+		// Work out the linear acceleration from force
+		float resultingAccX = s.accelerationX[i] + s.forceAccumX[i] * s.inverseMass[i];
+		float resultingAccY = s.accelerationY[i] + s.forceAccumY[i] * s.inverseMass[i];
+		s.lastAccelerationX[i] = resultingAccX;
+		s.lastAccelerationY[i] = resultingAccY;
+
+		// Work out angular acceleration from torque
+		float angularAcc = s.angularAcceleration[i] + s.torqueAccum[i];
+
+		// Update linear velocity from the acceleration and impulse.
+		s.velocityX[i] += resultingAccX * duration;
+		s.velocityY[i] += resultingAccY * duration;
+
+		// Update angular velocity from impulse
+		s.angularVelocity[i] += angularAcc * duration;
+
+		// Impose drag.
+		float drag = linearDrag.get(s.damping[i]);
+		s.velocityX[i] *= drag;
+		s.velocityY[i] *= drag;
+		s.angularVelocity[i] *= angularDrag.get(s.angularDamping[i]);
+
+		// Clear accumulated forces and torques now they have been integrated.
+		s.forceAccumX[i] = 0; s.forceAccumY[i] = 0;
+		s.torqueAccum[i] = 0;
+	}
+
+	void integrateScalar(ParticleStore &s, unsigned begin, unsigned end, float duration)
+	{
+		DragCache linearDrag(duration, s.damping[begin]);
+		DragCache angularDrag(duration, s.angularDamping[begin]);
+
+		for (unsigned i = begin; i < end; i++)
+		{
+			integrateRow(s, i, duration, linearDrag, angularDrag);
+		}
+	}
+
+#ifdef PSTORE_X86
+
+	/*
+		Fills the drag factors for a block of particles.  When every particle in
+		the block has the cached damping value (the usual case) this is a single
+		compare, otherwise each lane is looked up through the cache.
+	*/
+	template <unsigned width>
+	inline bool sameDamping(const float *values, float damping)
+	{
+		for (unsigned lane = 0; lane < width; lane++)
+		{
+			if (values[lane] != damping) return false;
+		}
+		return true;
+	}
+
+	// Returns an all-ones lane for each of the 4 particles that is awake.
+	TARGET_SSE2
+	inline __m128 awakeMask(const unsigned char *awake)
+	{
+		int flags;
+		memcpy(&flags, awake, sizeof(flags));
+
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lanes = _mm_cvtsi32_si128(flags);
+		lanes = _mm_unpacklo_epi8(lanes, zero);
+		lanes = _mm_unpacklo_epi16(lanes, zero);
+		return _mm_castsi128_ps(_mm_cmpgt_epi32(lanes, zero));
+	}
+
+	template <unsigned width>
+	inline void dragFactors(const float *values, DragCache &cache, float *factors)
+	{
+		for (unsigned lane = 0; lane < width; lane++)
+		{
+			factors[lane] = cache.get(values[lane]);
+		}
+	}
+
+	TARGET_SSE2
+	void integrateSSE2(ParticleStore &s, unsigned begin, unsigned end, float duration)
+	{
+		DragCache linearDrag(duration, s.damping[begin]);
+		DragCache angularDrag(duration, s.angularDamping[begin]);
+
+		const __m128 dt = _mm_set1_ps(duration);
+		const __m128 zero = _mm_setzero_ps();
+		float linearFactors[4], angularFactors[4];
+
+		unsigned i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 inverseMass = _mm_loadu_ps(&s.inverseMass[i]);
+			// Lanes holding particles of infinite mass, or asleep, are left untouched.
+			__m128 active = _mm_and_ps(_mm_cmpgt_ps(inverseMass, zero), awakeMask(&s.awake[i]));
+			if (_mm_movemask_ps(active) == 0) continue;
+
+			__m128 px = _mm_loadu_ps(&s.positionX[i]);
+			__m128 py = _mm_loadu_ps(&s.positionY[i]);
+			__m128 vx = _mm_loadu_ps(&s.velocityX[i]);
+			__m128 vy = _mm_loadu_ps(&s.velocityY[i]);
+			__m128 o = _mm_loadu_ps(&s.orientation[i]);
+			__m128 av = _mm_loadu_ps(&s.angularVelocity[i]);
+			__m128 fx = _mm_loadu_ps(&s.forceAccumX[i]);
+			__m128 fy = _mm_loadu_ps(&s.forceAccumY[i]);
+			__m128 torque = _mm_loadu_ps(&s.torqueAccum[i]);
+
+			// update position and orientation based on velocity
+			__m128 newPx = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+			__m128 newPy = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+			__m128 newO = _mm_add_ps(o, _mm_mul_ps(av, dt));
+
+			// Work out the linear and angular acceleration from force and torque
+			__m128 accX = _mm_add_ps(_mm_loadu_ps(&s.accelerationX[i]), _mm_mul_ps(fx, inverseMass));
+			__m128 accY = _mm_add_ps(_mm_loadu_ps(&s.accelerationY[i]), _mm_mul_ps(fy, inverseMass));
+			__m128 angularAcc = _mm_add_ps(_mm_loadu_ps(&s.angularAcceleration[i]), torque);
+
+			__m128 newVx = _mm_add_ps(vx, _mm_mul_ps(accX, dt));
+			__m128 newVy = _mm_add_ps(vy, _mm_mul_ps(accY, dt));
+			__m128 newAv = _mm_add_ps(av, _mm_mul_ps(angularAcc, dt));
+
+			// Impose drag.
+			__m128 linear, angular;
+			if (sameDamping<4>(&s.damping[i], linearDrag.damping)) linear = _mm_set1_ps(linearDrag.factor);
+			else { dragFactors<4>(&s.damping[i], linearDrag, linearFactors); linear = _mm_loadu_ps(linearFactors); }
+			if (sameDamping<4>(&s.angularDamping[i], angularDrag.damping)) angular = _mm_set1_ps(angularDrag.factor);
+			else { dragFactors<4>(&s.angularDamping[i], angularDrag, angularFactors); angular = _mm_loadu_ps(angularFactors); }
+
+			newVx = _mm_mul_ps(newVx, linear);
+			newVy = _mm_mul_ps(newVy, linear);
+			newAv = _mm_mul_ps(newAv, angular);
+
+			// Write back, keeping the old values in inactive lanes.
+#define PSTORE_SELECT(newValue, oldValue) _mm_or_ps(_mm_and_ps(active, newValue), _mm_andnot_ps(active, oldValue))
+			_mm_storeu_ps(&s.positionX[i], PSTORE_SELECT(newPx, px));
+			_mm_storeu_ps(&s.positionY[i], PSTORE_SELECT(newPy, py));
+			_mm_storeu_ps(&s.orientation[i], PSTORE_SELECT(newO, o));
+			_mm_storeu_ps(&s.velocityX[i], PSTORE_SELECT(newVx, vx));
+			_mm_storeu_ps(&s.velocityY[i], PSTORE_SELECT(newVy, vy));
+			_mm_storeu_ps(&s.angularVelocity[i], PSTORE_SELECT(newAv, av));
+			_mm_storeu_ps(&s.lastAccelerationX[i], PSTORE_SELECT(accX, _mm_loadu_ps(&s.lastAccelerationX[i])));
+			_mm_storeu_ps(&s.lastAccelerationY[i], PSTORE_SELECT(accY, _mm_loadu_ps(&s.lastAccelerationY[i])));
+
+			// Clear accumulated forces and torques now they have been integrated.
+			_mm_storeu_ps(&s.forceAccumX[i], PSTORE_SELECT(zero, fx));
+			_mm_storeu_ps(&s.forceAccumY[i], PSTORE_SELECT(zero, fy));
+			_mm_storeu_ps(&s.torqueAccum[i], PSTORE_SELECT(zero, torque));
+#undef PSTORE_SELECT
+		}
+
+		for (; i < end; i++)
+		{
+			integrateRow(s, i, duration, linearDrag, angularDrag);
+		}
+	}
+
+	TARGET_AVX
+	void integrateAVX(ParticleStore &s, unsigned begin, unsigned end, float duration)
+	{
+		DragCache linearDrag(duration, s.damping[begin]);
+		DragCache angularDrag(duration, s.angularDamping[begin]);
+
+		const __m256 dt = _mm256_set1_ps(duration);
+		const __m256 zero = _mm256_setzero_ps();
+		float linearFactors[8], angularFactors[8];
+
+		unsigned i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 inverseMass = _mm256_loadu_ps(&s.inverseMass[i]);
+			// Lanes holding particles of infinite mass, or asleep, are left untouched.
+			__m256 awake = _mm256_insertf128_ps(_mm256_castps128_ps256(awakeMask(&s.awake[i])), awakeMask(&s.awake[i + 4]), 1);
+			__m256 active = _mm256_and_ps(_mm256_cmp_ps(inverseMass, zero, _CMP_GT_OQ), awake);
+			if (_mm256_movemask_ps(active) == 0) continue;
+
+			__m256 px = _mm256_loadu_ps(&s.positionX[i]);
+			__m256 py = _mm256_loadu_ps(&s.positionY[i]);
+			__m256 vx = _mm256_loadu_ps(&s.velocityX[i]);
+			__m256 vy = _mm256_loadu_ps(&s.velocityY[i]);
+			__m256 o = _mm256_loadu_ps(&s.orientation[i]);
+			__m256 av = _mm256_loadu_ps(&s.angularVelocity[i]);
+			__m256 fx = _mm256_loadu_ps(&s.forceAccumX[i]);
+			__m256 fy = _mm256_loadu_ps(&s.forceAccumY[i]);
+			__m256 torque = _mm256_loadu_ps(&s.torqueAccum[i]);
+
+			// update position and orientation based on velocity
+			__m256 newPx = _mm256_add_ps(px, _mm256_mul_ps(vx, dt));
+			__m256 newPy = _mm256_add_ps(py, _mm256_mul_ps(vy, dt));
+			__m256 newO = _mm256_add_ps(o, _mm256_mul_ps(av, dt));
+
+			// Work out the linear and angular acceleration from force and torque
+			__m256 accX = _mm256_add_ps(_mm256_loadu_ps(&s.accelerationX[i]), _mm256_mul_ps(fx, inverseMass));
+			__m256 accY = _mm256_add_ps(_mm256_loadu_ps(&s.accelerationY[i]), _mm256_mul_ps(fy, inverseMass));
+			__m256 angularAcc = _mm256_add_ps(_mm256_loadu_ps(&s.angularAcceleration[i]), torque);
+
+			__m256 newVx = _mm256_add_ps(vx, _mm256_mul_ps(accX, dt));
+			__m256 newVy = _mm256_add_ps(vy, _mm256_mul_ps(accY, dt));
+			__m256 newAv = _mm256_add_ps(av, _mm256_mul_ps(angularAcc, dt));
+
+			// Impose drag.
+			__m256 linear, angular;
+			if (sameDamping<8>(&s.damping[i], linearDrag.damping)) linear = _mm256_set1_ps(linearDrag.factor);
+			else { dragFactors<8>(&s.damping[i], linearDrag, linearFactors); linear = _mm256_loadu_ps(linearFactors); }
+			if (sameDamping<8>(&s.angularDamping[i], angularDrag.damping)) angular = _mm256_set1_ps(angularDrag.factor);
+			else { dragFactors<8>(&s.angularDamping[i], angularDrag, angularFactors); angular = _mm256_loadu_ps(angularFactors); }
+
+			newVx = _mm256_mul_ps(newVx, linear);
+			newVy = _mm256_mul_ps(newVy, linear);
+			newAv = _mm256_mul_ps(newAv, angular);
+
+			// Write back, keeping the old values in inactive lanes.
+			_mm256_storeu_ps(&s.positionX[i], _mm256_blendv_ps(px, newPx, active));
+			_mm256_storeu_ps(&s.positionY[i], _mm256_blendv_ps(py, newPy, active));
+			_mm256_storeu_ps(&s.orientation[i], _mm256_blendv_ps(o, newO, active));
+			_mm256_storeu_ps(&s.velocityX[i], _mm256_blendv_ps(vx, newVx, active));
+			_mm256_storeu_ps(&s.velocityY[i], _mm256_blendv_ps(vy, newVy, active));
+			_mm256_storeu_ps(&s.angularVelocity[i], _mm256_blendv_ps(av, newAv, active));
+			_mm256_storeu_ps(&s.lastAccelerationX[i], _mm256_blendv_ps(_mm256_loadu_ps(&s.lastAccelerationX[i]), accX, active));
+			_mm256_storeu_ps(&s.lastAccelerationY[i], _mm256_blendv_ps(_mm256_loadu_ps(&s.lastAccelerationY[i]), accY, active));
+
+			// Clear accumulated forces and torques now they have been integrated.
+			_mm256_storeu_ps(&s.forceAccumX[i], _mm256_blendv_ps(fx, zero, active));
+			_mm256_storeu_ps(&s.forceAccumY[i], _mm256_blendv_ps(fy, zero, active));
+			_mm256_storeu_ps(&s.torqueAccum[i], _mm256_blendv_ps(torque, zero, active));
+		}
+
+		for (; i < end; i++)
+		{
+			integrateRow(s, i, duration, linearDrag, angularDrag);
+		}
+	}
+
+	// Returns true if the processor (and operating system) support SSE2.
+	bool cpuHasSSE2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+#else
+		return __builtin_cpu_supports("sse2");
+#endif
+	}
+
+	// Returns true if the processor (and operating system) support AVX.
+	bool cpuHasAVX()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool osSavesState = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// The operating system must also save the upper halves of the registers.
+		return osSavesState && avx && (_xgetbv(0) & 6) == 6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+
+#endif // PSTORE_X86
+
+	// Returns the widest path supported that is no wider than the one requested.
+	ParticleStore::IntegrationPath resolvePath(ParticleStore::IntegrationPath path)
+	{
+#ifdef PSTORE_X86
+		if (path == ParticleStore::INTEGRATE_AUTO) path = ParticleStore::INTEGRATE_AVX;
+		if (path == ParticleStore::INTEGRATE_AVX && !cpuHasAVX()) path = ParticleStore::INTEGRATE_SSE2;
+		if (path == ParticleStore::INTEGRATE_SSE2 && !cpuHasSSE2()) path = ParticleStore::INTEGRATE_SCALAR;
+		return path;
+#else
+		return ParticleStore::INTEGRATE_SCALAR;
+#endif
+	}
+}
+
+ParticleStore::ParticleStore()
+:
+integrationPath(resolvePath(INTEGRATE_AUTO))
+{
+}
+
+unsigned ParticleStore::add()
+{
+	unsigned index = size();
+
+	positionX.push_back(0); positionY.push_back(0);
+	velocityX.push_back(0); velocityY.push_back(0);
+	accelerationX.push_back(0); accelerationY.push_back(0);
+	lastAccelerationX.push_back(0); lastAccelerationY.push_back(0);
+	forceAccumX.push_back(0); forceAccumY.push_back(0);
+	inverseMass.push_back(0);
+	damping.push_back(0);
+	angularDamping.push_back(0);
+	radius.push_back(0);
+	orientation.push_back(0);
+	angularVelocity.push_back(0);
+	angularAcceleration.push_back(0);
+	torqueAccum.push_back(0);
+	awake.push_back(1);
+
+	return index;
+}
+
+unsigned ParticleStore::add(unsigned count)
+{
+	unsigned index = size();
+	unsigned newSize = index + count;
+
+	positionX.resize(newSize, 0); positionY.resize(newSize, 0);
+	velocityX.resize(newSize, 0); velocityY.resize(newSize, 0);
+	accelerationX.resize(newSize, 0); accelerationY.resize(newSize, 0);
+	lastAccelerationX.resize(newSize, 0); lastAccelerationY.resize(newSize, 0);
+	forceAccumX.resize(newSize, 0); forceAccumY.resize(newSize, 0);
+	inverseMass.resize(newSize, 0);
+	damping.resize(newSize, 0);
+	angularDamping.resize(newSize, 0);
+	radius.resize(newSize, 0);
+	orientation.resize(newSize, 0);
+	angularVelocity.resize(newSize, 0);
+	angularAcceleration.resize(newSize, 0);
+	torqueAccum.resize(newSize, 0);
+	awake.resize(newSize, 1);
+
+	return index;
+}
+
+void ParticleStore::reserve(unsigned count)
+{
+	positionX.reserve(count); positionY.reserve(count);
+	velocityX.reserve(count); velocityY.reserve(count);
+	accelerationX.reserve(count); accelerationY.reserve(count);
+	lastAccelerationX.reserve(count); lastAccelerationY.reserve(count);
+	forceAccumX.reserve(count); forceAccumY.reserve(count);
+	inverseMass.reserve(count);
+	damping.reserve(count);
+	angularDamping.reserve(count);
+	radius.reserve(count);
+	orientation.reserve(count);
+	angularVelocity.reserve(count);
+	angularAcceleration.reserve(count);
+	torqueAccum.reserve(count);
+	awake.reserve(count);
+}
+
+unsigned ParticleStore::size() const
+{
+	return (unsigned)positionX.size();
+}
+
+void ParticleStore::clear()
+{
+	positionX.clear(); positionY.clear();
+	velocityX.clear(); velocityY.clear();
+	accelerationX.clear(); accelerationY.clear();
+	lastAccelerationX.clear(); lastAccelerationY.clear();
+	forceAccumX.clear(); forceAccumY.clear();
+	inverseMass.clear();
+	damping.clear();
+	angularDamping.clear();
+	radius.clear();
+	orientation.clear();
+	angularVelocity.clear();
+	angularAcceleration.clear();
+	torqueAccum.clear();
+	awake.clear();
+}
+
+// Update position and velocity of the particles based on the given duration.
+void ParticleStore::integrate(unsigned begin, unsigned end, float duration)
+{
+	assert(duration > 0.0);
+	if (begin >= end) return;
+
+	switch (integrationPath)
+	{
+#ifdef PSTORE_X86
+	case INTEGRATE_AVX:
+		integrateAVX(*this, begin, end, duration);
+		break;
+	case INTEGRATE_SSE2:
+		integrateSSE2(*this, begin, end, duration);
+		break;
+#endif
+	default:
+		integrateScalar(*this, begin, end, duration);
+		break;
+	}
+}
+
+void ParticleStore::setIntegrationPath(IntegrationPath path)
+{
+	integrationPath = resolvePath(path);
+}
+
+ParticleStore::IntegrationPath ParticleStore::getIntegrationPath() const
+{
+	return integrationPath;
+}
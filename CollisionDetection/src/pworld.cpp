@@ -1,73 +1,627 @@
 
 #include <cstdlib>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
 #include <pworld.h>
+#include <checkpoint.h>
+#include <segments.h>
+
+typedef std::chrono::steady_clock StepClock;
+
+// Returns the seconds since the given time, and moves it on to now.
+static float lapTime(StepClock::time_point &last)
+{
+    StepClock::time_point now = StepClock::now();
+    float seconds = std::chrono::duration<float>(now - last).count();
+    last = now;
+    return seconds;
+}
 
 ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations)
 :
 resolver(iterations),
-maxContacts(maxContacts)
+contactLimit(0),
+stepTiming(false),
+sleepEnergy(0),
+sleepFrames(0),
+awakeCount(0),
+deterministic(false),
+contactCaching(false)
 {
-    contacts = new ParticleContact[maxContacts];
+    contacts.resize(maxContacts > 0 ? maxContacts : 1);
+
+    contactStats.requested = 0;
+    contactStats.dropped = 0;
+    contactStats.capacity = (unsigned)contacts.size();
+    contactStats.highWater = 0;
+    contactStats.growths = 0;
+
+    stepStats.integrateTime = 0;
+    stepStats.generateTime = 0;
+    stepStats.resolveTime = 0;
+    stepStats.sleepTime = 0;
+    stepStats.totalTime = 0;
+    stepStats.contactsGenerated = 0;
+    stepStats.contactsDropped = 0;
+    stepStats.contactsResolved = 0;
+    stepStats.contactsCached = 0;
+    stepStats.iterationsUsed = 0;
+    stepStats.iterationBudget = 0;
+    stepStats.awakeCount = 0;
+
     calculateIterations = (iterations == 0);
 
 }
 
 ParticleWorld::~ParticleWorld()
 {
-    delete[] contacts;
+    for (std::vector<Particle*>::iterator b = particleBlocks.begin();
+        b != particleBlocks.end();
+        b++)
+    {
+        delete[] *b;
+    }
+}
+
+Particle* ParticleWorld::createParticles(unsigned count)
+{
+    Particle *block = new Particle[count];
+    particleBlocks.push_back(block);
+
+    unsigned first = store.add(count);
+    particles.reserve(particles.size() + count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        block[i].bind(&store, first + i);
+        particles.push_back(block + i);
+    }
+
+    return block;
+}
+
+void ParticleWorld::growBuffer(std::vector<ParticleContact> &buffer, size_t size)
+{
+    if (buffer.size() >= size) return;
+    buffer.resize(std::max(size, buffer.size() * 2));
+}
+
+unsigned ParticleWorld::limitContacts(unsigned generated)
+{
+    contactStats.requested = generated;
+    contactStats.dropped = 0;
+    if (contactLimit > 0 && generated > contactLimit)
+    {
+        contactStats.dropped = generated - contactLimit;
+        generated = contactLimit;
+    }
+
+    if (contactStats.requested > contactStats.highWater) contactStats.highWater = contactStats.requested;
+    contactStats.capacity = (unsigned)contacts.size();
+    return generated;
 }
 
 unsigned ParticleWorld::generateContacts()
 {
-    unsigned limit = maxContacts;
-    ParticleContact *nextContact = contacts;
+    if (pool.getThreadCount() > 1)
+    {
+        unsigned parts = 0;
+        for (ContactGenerators::iterator g = contactGenerators.begin();
+            g != contactGenerators.end();
+            g++)
+        {
+            parts += (*g)->getPartCount();
+        }
+        if (parts > 1) return generateContactsParallel();
+    }
+
+    unsigned used = 0;
 
     for (ContactGenerators::iterator g = contactGenerators.begin();
         g != contactGenerators.end();
         g++)
     {
-        unsigned used =(*g)->addContact(nextContact, limit);
-        limit -= used;
-        nextContact += used;
+        unsigned start = used;
+        for (;;)
+        {
+            if (used == contacts.size())
+            {
+                growBuffer(contacts, used + 1);
+                contactStats.growths++;
+            }
+
+            unsigned room = (unsigned)contacts.size() - used;
+            unsigned generated = (*g)->addContact(&contacts[used], room);
+            if (generated < room)
+            {
+                used += generated;
+                break;
+            }
 
-        // We've run out of contacts to fill. This means we're missing
-        // contacts.
-		if (limit <= 0){
-			break;
-		}
+            // The generator filled the buffer, so it may have had more
+            // contacts to give. Make room and run it again.
+            growBuffer(contacts, contacts.size() + 1);
+            contactStats.growths++;
+        }
+
+        unsigned generator = (unsigned)(g - contactGenerators.begin());
+        for (unsigned i = start; i < used; i++) contacts[i].generator = generator;
     }
 
     // Return the number of contacts used.
-    return maxContacts - limit;
+    return limitContacts(used);
 }
 
-void ParticleWorld::integrate(float duration)
+unsigned ParticleWorld::generateContactsParallel()
 {
-    for (Particles::iterator p = particles.begin();
-        p != particles.end();
-        p++)
+    /*
+        Generators are split in to their parts (e.g. a grid's rows), which
+        are shared out between the threads, each appending its contacts to
+        the buffer of the thread running it. A prefix sum over the parts'
+        counts, in order, then gives where each part's contacts go in the
+        contact array, so they can be copied in parallel and end up in the
+        same order as running the generators one after another. Contacts
+        past the contact limit are trimmed from the end, as they would be
+        serially.
+    */
+    partGenerator.clear();
+    partIndex.clear();
+    for (unsigned g = 0; g < contactGenerators.size(); g++)
     {
-        // Remove all forces from the accumulator
-        (*p)->integrate(duration);
+        // Shared work, like binning, is done before any part runs.
+        contactGenerators[g]->prepareParts();
+
+        unsigned parts = contactGenerators[g]->getPartCount();
+        for (unsigned p = 0; p < parts; p++)
+        {
+            partGenerator.push_back(g);
+            partIndex.push_back(p);
+        }
     }
+
+    unsigned partCount = (unsigned)partGenerator.size();
+    unsigned threadCount = pool.getThreadCount();
+
+    threadContacts.resize(threadCount);
+    threadUsed.assign(threadCount, 0);
+    partThread.resize(partCount);
+    partOffset.resize(partCount);
+    partUsed.resize(partCount);
+    partStart.resize(partCount);
+
+    // Small chunks keep the threads balanced when a few parts (e.g. a
+    // crowded row of the grid) are much more expensive than the rest.
+    unsigned grainSize = partCount / (threadCount * 8);
+    if (grainSize < 1) grainSize = 1;
+
+    pool.parallelFor(partCount, grainSize,
+        [this](unsigned begin, unsigned end, unsigned thread)
+        {
+            std::vector<ParticleContact> &buffer = threadContacts[thread];
+
+            for (unsigned p = begin; p < end; p++)
+            {
+                const ParticleContactGenerator *generator = contactGenerators[partGenerator[p]];
+                unsigned offset = threadUsed[thread];
+                unsigned used;
+                for (;;)
+                {
+                    // Keep some room free, growing geometrically so this
+                    // settles quickly.
+                    growBuffer(buffer, offset + 64);
+
+                    unsigned room = (unsigned)buffer.size() - offset;
+                    used = generator->addPartContact(&buffer[offset], room, partIndex[p]);
+                    if (used < room) break;
+
+                    // Filled, so there may be more. Make room and run it again.
+                    growBuffer(buffer, buffer.size() + 1);
+                }
+
+                partThread[p] = thread;
+                partOffset[p] = offset;
+                partUsed[p] = used;
+                threadUsed[thread] = offset + used;
+            }
+        });
+
+    // Exclusive prefix sum of the counts.
+    unsigned total = 0;
+    for (unsigned p = 0; p < partCount; p++)
+    {
+        partStart[p] = total;
+        total += partUsed[p];
+    }
+
+    if (total > contacts.size())
+    {
+        growBuffer(contacts, total);
+        contactStats.growths++;
+    }
+
+    // Only the contacts under the limit are kept.
+    unsigned kept = limitContacts(total);
+    for (unsigned p = 0; p < partCount; p++)
+    {
+        if (partStart[p] >= kept) partUsed[p] = 0;
+        else partUsed[p] = std::min(partUsed[p], kept - partStart[p]);
+    }
+
+    pool.parallelFor(partCount, grainSize,
+        [this](unsigned begin, unsigned end, unsigned)
+        {
+            for (unsigned p = begin; p < end; p++)
+            {
+                if (partUsed[p] == 0) continue;
+                const ParticleContact *source = &threadContacts[partThread[p]][0] + partOffset[p];
+                ParticleContact *destination = &contacts[0] + partStart[p];
+                std::copy(source, source + partUsed[p], destination);
+                for (unsigned i = 0; i < partUsed[p]; i++) destination[i].generator = partGenerator[p];
+            }
+        });
+
+    return kept;
+}
+
+void ParticleWorld::integrate(float duration)
+{
+    // Integrate the columns of the store directly, rather than going
+    // through each particle's handle. Chunks are a multiple of the vector
+    // width so each one runs on the vector path.
+    const unsigned grainSize = 4096;
+
+    pool.parallelFor(store.size(), grainSize,
+        [this, duration](unsigned begin, unsigned end, unsigned)
+        {
+            store.integrate(begin, end, duration);
+        });
 }
 
 void ParticleWorld::runPhysics(float duration)
 {
+    StepClock::time_point start, lap;
+    if (stepTiming) start = lap = StepClock::now();
+
+    // First apply the force generators
+    registry.updateForces(store, duration, &pool);
 
     // Then integrate the objects
     integrate(duration);
+    if (stepTiming) stepStats.integrateTime = lapTime(lap);
 
     // Generate contacts
     unsigned usedContacts = generateContacts();
+    if (stepTiming) stepStats.generateTime = lapTime(lap);
+
+    if (deterministic) sortContacts(usedContacts);
+
+    // Wake anything hit by an awake particle, and drop the contacts
+    // between sleeping particles.
+    float sleepTime = 0;
+    if (sleepEnergy > 0)
+    {
+        usedContacts = wakeTouchedIslands(usedContacts);
+        if (stepTiming) sleepTime = lapTime(lap);
+    }
+
+    // Pick up the impulses the contacts applied last step.
+    if (contactCaching) contactCache.fetch(&contacts[0], usedContacts);
 
     // And process them
+    stepStats.iterationsUsed = 0;
+    stepStats.iterationBudget = 0;
     if (usedContacts)
     {
 		// If number of iterations wasn't set , set automatically for resolver.
         if (calculateIterations) resolver.setIterations(usedContacts * 2);
 		// Resolve contacts up to "iterations" times.
-        resolver.resolveContacts(contacts, usedContacts, duration);
+        resolver.resolveContacts(&contacts[0], usedContacts, duration, &pool);
+
+        stepStats.iterationsUsed = resolver.getIterationsUsed();
+        stepStats.iterationBudget = resolver.getIterationBudget();
+    }
+    if (contactCaching) contactCache.store(&contacts[0], usedContacts);
+    if (stepTiming) stepStats.resolveTime = lapTime(lap);
+
+    if (sleepEnergy > 0) updateSleeping(usedContacts);
+    else awakeCount = store.size();
+
+    if (stepTiming)
+    {
+        stepStats.sleepTime = sleepTime + lapTime(lap);
+        stepStats.totalTime = std::chrono::duration<float>(lap - start).count();
+    }
+
+    stepStats.contactsGenerated = contactStats.requested;
+    stepStats.contactsDropped = contactStats.dropped;
+    stepStats.contactsResolved = usedContacts;
+    // Only the PGS mode warm starts from the cached impulses.
+    bool warmStarted = contactCaching && resolver.getMode() == ParticleContactResolver::SOLVE_PGS;
+    stepStats.contactsCached = warmStarted ? contactCache.getHits() : 0;
+    stepStats.awakeCount = awakeCount;
+}
+
+void ParticleWorld::runPhysicsSubstepped(float duration, unsigned substeps)
+{
+    StepClock::time_point start, lap;
+    if (stepTiming) start = lap = StepClock::now();
+
+    if (substeps < 1) substeps = 1;
+    float substep = duration / substeps;
+
+    // Apply the forces for the first substep now, so the margins below
+    // take them in.
+    registry.updateForces(store, substep, &pool);
+
+    /*
+        Grow each particle by how far it could move this frame (including
+        where its acceleration and forces take it, so particles resting on
+        something find their contacts), so the generators report every
+        contact that might be made during the frame, from where the
+        particles are now.
+        Contacts further apart than the margins are reported with negative
+        penetration, and only pushed on once they close. A broad phase
+        sized for the real radii may miss some pairs the margins reach,
+        which are then found next frame instead.
+    */
+    unsigned count = store.size();
+    frameRadius.assign(store.radius.begin(), store.radius.end());
+    frameMargin.assign(count, 0.0f);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (store.inverseMass[i] <= 0.0f || !store.awake[i]) continue;
+
+        float accelerationX = store.accelerationX[i] + store.forceAccumX[i] * store.inverseMass[i];
+        float accelerationY = store.accelerationY[i] + store.forceAccumY[i] * store.inverseMass[i];
+        float moveX = (store.velocityX[i] + accelerationX * duration) * duration;
+        float moveY = (store.velocityY[i] + accelerationY * duration) * duration;
+        frameMargin[i] = sqrtf(moveX * moveX + moveY * moveY);
+        store.radius[i] += frameMargin[i];
+    }
+    float integrateTime = 0;
+    if (stepTiming) integrateTime = lapTime(lap);
+
+    // Generate contacts once for the whole frame, then take the margins
+    // back off.
+    unsigned usedContacts = generateContacts();
+    store.radius.swap(frameRadius);
+    for (unsigned i = 0; i < usedContacts; i++)
+    {
+        ParticleContact &contact = contacts[i];
+        contact.penetration -= frameMargin[contact.particle[0]->getIndex()];
+        if (contact.particle[1]) contact.penetration -= frameMargin[contact.particle[1]->getIndex()];
+    }
+    if (deterministic) sortContacts(usedContacts);
+    if (stepTiming) stepStats.generateTime = lapTime(lap);
+
+    float sleepTime = 0;
+    if (sleepEnergy > 0)
+    {
+        usedContacts = wakeTouchedIslands(usedContacts);
+        if (stepTiming) sleepTime = lapTime(lap);
+    }
+
+    float resolveTime = 0;
+    if (usedContacts) resolver.beginSubsteps(&contacts[0], usedContacts, duration);
+    if (stepTiming) resolveTime = lapTime(lap);
+
+    for (unsigned s = 0; s < substeps; s++)
+    {
+        if (s > 0) registry.updateForces(store, substep, &pool);
+        integrate(substep);
+        if (stepTiming) integrateTime += lapTime(lap);
+
+        if (usedContacts) resolver.projectContacts(&contacts[0], usedContacts, substep);
+        if (stepTiming) resolveTime += lapTime(lap);
+    }
+
+    stepStats.iterationsUsed = usedContacts ? resolver.getIterationsUsed() : 0;
+    stepStats.iterationBudget = usedContacts * substeps;
+
+    if (sleepEnergy > 0) updateSleeping(usedContacts);
+    else awakeCount = store.size();
+
+    if (stepTiming)
+    {
+        stepStats.integrateTime = integrateTime;
+        stepStats.resolveTime = resolveTime;
+        stepStats.sleepTime = sleepTime + lapTime(lap);
+        stepStats.totalTime = std::chrono::duration<float>(lap - start).count();
+    }
+
+    stepStats.contactsGenerated = contactStats.requested;
+    stepStats.contactsDropped = contactStats.dropped;
+    stepStats.contactsResolved = usedContacts;
+    stepStats.contactsCached = 0;
+    stepStats.awakeCount = awakeCount;
+}
+
+void ParticleWorld::sortContacts(unsigned numContacts)
+{
+    if (numContacts < 2) return;
+
+    // Every key is unique, so any sort gives the same order.
+    contactOrder.resize(numContacts);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned long long first = contacts[i].particle[0]->getIndex() + 1ull;
+        unsigned long long second = contacts[i].particle[1] ? contacts[i].particle[1]->getIndex() + 1ull : 0;
+        if (first > second) std::swap(first, second);
+
+        contactOrder[i].particles = (first << 32) | second;
+        contactOrder[i].index = i;
+    }
+    std::sort(contactOrder.begin(), contactOrder.end());
+
+    // Gather in to the scratch buffer and swap it in, keeping it as large
+    // as the contact buffer so growing one doesn't strand the other.
+    if (sortedContacts.size() < contacts.size()) sortedContacts.resize(contacts.size());
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        sortedContacts[i] = contacts[contactOrder[i].index];
+    }
+    contacts.swap(sortedContacts);
+}
+
+unsigned ParticleWorld::findIsland(unsigned particle)
+{
+    // Walk to the root, halving the path as we go to keep the trees flat.
+    while (islandParent[particle] != particle)
+    {
+        islandParent[particle] = islandParent[islandParent[particle]];
+        particle = islandParent[particle];
+    }
+    return particle;
+}
+
+unsigned ParticleWorld::wakeTouchedIslands(unsigned numContacts)
+{
+    unsigned count = store.size();
+
+    // Particles added since the last step start in an island of their own
+    // with no history.
+    for (unsigned p = (unsigned)islandId.size(); p < count; p++) islandId.push_back(p);
+    restFrames.resize(count, 0);
+
+    islandWake.assign(count, 0);
+
+    // Mark the islands of sleeping particles touching an awake, movable one.
+    // Speculative contacts (with a negative penetration) aren't touching.
+    bool anyWake = false;
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        Particle *first = contacts[i].particle[0];
+        Particle *second = contacts[i].particle[1];
+        if (!second || contacts[i].penetration < 0) continue;
+
+        bool firstActive = first->isAwake() && first->getInverseMass() > 0;
+        bool secondActive = second->isAwake() && second->getInverseMass() > 0;
+
+        if (firstActive && !second->isAwake())
+        {
+            islandWake[islandId[second->getIndex()]] = 1;
+            anyWake = true;
+        }
+        else if (secondActive && !first->isAwake())
+        {
+            islandWake[islandId[first->getIndex()]] = 1;
+            anyWake = true;
+        }
+    }
+
+    if (anyWake)
+    {
+        for (unsigned p = 0; p < count; p++)
+        {
+            if (!store.awake[p] && islandWake[islandId[p]])
+            {
+                store.awake[p] = 1;
+                restFrames[p] = 0;
+            }
+        }
+    }
+
+    // Keep only the contacts with something awake and movable in them.
+    unsigned kept = 0;
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned first = contacts[i].particle[0]->getIndex();
+        bool active = store.awake[first] && store.inverseMass[first] > 0;
+        if (!active && contacts[i].particle[1])
+        {
+            unsigned second = contacts[i].particle[1]->getIndex();
+            active = store.awake[second] && store.inverseMass[second] > 0;
+        }
+
+        if (!active) continue;
+        if (kept != i) contacts[kept] = contacts[i];
+        kept++;
+    }
+    return kept;
+}
+
+void ParticleWorld::updateSleeping(unsigned numContacts)
+{
+    unsigned count = store.size();
+
+    // Every particle starts in its own island, then contacts between two
+    // movable particles join their islands. Contacts with the scenery or
+    // immovable particles don't, otherwise everything resting on the same
+    // platform would be one island, and nor do speculative contacts between
+    // particles that are only near each other.
+    islandParent.resize(count);
+    for (unsigned p = 0; p < count; p++) islandParent[p] = p;
+
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        if (!contacts[i].particle[1] || contacts[i].penetration < 0) continue;
+        unsigned first = contacts[i].particle[0]->getIndex();
+        unsigned second = contacts[i].particle[1]->getIndex();
+        if (store.inverseMass[first] <= 0 || store.inverseMass[second] <= 0) continue;
+
+        unsigned firstRoot = findIsland(first);
+        unsigned secondRoot = findIsland(second);
+        // Always hang the higher root off the lower, so islands don't depend
+        // on contact order beyond which particles they hold.
+        if (firstRoot < secondRoot) islandParent[secondRoot] = firstRoot;
+        else if (secondRoot < firstRoot) islandParent[firstRoot] = secondRoot;
+    }
+
+    // Find the most energetic particle of each island, and how long its
+    // least rested particle has been resting.
+    islandEnergy.assign(count, 0);
+    islandRest.assign(count, ~0u);
+    for (unsigned p = 0; p < count; p++)
+    {
+        if (!store.awake[p] || store.inverseMass[p] <= 0) continue;
+
+        float mass = 1.0f / store.inverseMass[p];
+        float speedSquared = store.velocityX[p] * store.velocityX[p] + store.velocityY[p] * store.velocityY[p];
+        // Spin is counted as for a disc: 1/2 I w^2 with I = 1/2 m r^2.
+        float spin = store.angularVelocity[p] * store.radius[p];
+        float energy = 0.5f * mass * speedSquared + 0.25f * mass * spin * spin;
+
+        unsigned root = findIsland(p);
+        if (energy > islandEnergy[root]) islandEnergy[root] = energy;
+    }
+
+    for (unsigned p = 0; p < count; p++)
+    {
+        if (!store.awake[p] || store.inverseMass[p] <= 0) continue;
+
+        unsigned root = findIsland(p);
+        if (islandEnergy[root] < sleepEnergy) restFrames[p]++;
+        else restFrames[p] = 0;
+
+        if (restFrames[p] < islandRest[root]) islandRest[root] = restFrames[p];
+    }
+
+    // Put to sleep the islands that have rested long enough.
+    awakeCount = 0;
+    for (unsigned p = 0; p < count; p++)
+    {
+        if (!store.awake[p]) continue;
+        if (store.inverseMass[p] <= 0)
+        {
+            awakeCount++;
+            continue;
+        }
+
+        unsigned root = findIsland(p);
+        if (islandRest[root] >= sleepFrames)
+        {
+            store.awake[p] = 0;
+            store.velocityX[p] = 0;
+            store.velocityY[p] = 0;
+            store.angularVelocity[p] = 0;
+            islandId[p] = root;
+        }
+        else
+        {
+            awakeCount++;
+        }
     }
 }
 
@@ -76,7 +630,322 @@ ParticleWorld::Particles& ParticleWorld::getParticles()
     return particles;
 }
 
+void ParticleWorld::setContactLimit(unsigned limit)
+{
+    contactLimit = limit;
+}
+
+const ParticleWorld::ContactStats& ParticleWorld::getContactStats() const
+{
+    return contactStats;
+}
+
+void ParticleWorld::setStepTiming(bool enabled)
+{
+    stepTiming = enabled;
+    if (!enabled)
+    {
+        stepStats.integrateTime = 0;
+        stepStats.generateTime = 0;
+        stepStats.resolveTime = 0;
+        stepStats.sleepTime = 0;
+        stepStats.totalTime = 0;
+    }
+}
+
+const ParticleWorld::StepStats& ParticleWorld::getStepStats() const
+{
+    return stepStats;
+}
+
+void ParticleWorld::setSleeping(float energyThreshold, unsigned frames)
+{
+    sleepEnergy = energyThreshold;
+    sleepFrames = frames;
+
+    // Turning sleeping off wakes everything.
+    if (sleepEnergy <= 0)
+    {
+        std::fill(store.awake.begin(), store.awake.end(), 1);
+        std::fill(restFrames.begin(), restFrames.end(), 0);
+    }
+}
+
+unsigned ParticleWorld::getAwakeCount() const
+{
+    return awakeCount;
+}
+
+void ParticleWorld::setDeterministic(bool enabled)
+{
+    deterministic = enabled;
+}
+
+bool ParticleWorld::isDeterministic() const
+{
+    return deterministic;
+}
+
+void ParticleWorld::setContactCaching(bool enabled)
+{
+    contactCaching = enabled;
+    resolver.setWarmStarting(enabled);
+    contactCache.clear();
+}
+
+bool ParticleWorld::isContactCaching() const
+{
+    return contactCaching;
+}
+
+void ParticleWorld::setThreadCount(unsigned threadCount)
+{
+    pool.setThreadCount(threadCount);
+}
+
+unsigned ParticleWorld::getThreadCount() const
+{
+    return pool.getThreadCount();
+}
+
+// Writes a section of a checkpoint at the given offset, padding up to it first.
+static bool writeSection(FILE *file, uint64_t &position, uint64_t offset, const void *data, size_t bytes)
+{
+    static const char padding[CHECKPOINT_ALIGNMENT] = { 0 };
+    if (fwrite(padding, 1, (size_t)(offset - position), file) != offset - position) return false;
+    if (bytes > 0 && fwrite(data, 1, bytes, file) != bytes) return false;
+    position = offset + bytes;
+    return true;
+}
+
+bool ParticleWorld::saveCheckpoint(const char *path, const StaticSegments *segments)
+{
+    unsigned count = store.size();
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "PWORLDCK", 8);
+    header.version = CHECKPOINT_VERSION;
+    header.byteOrder = 0x01020304;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.particleCount = count;
+    header.segmentCount = segments ? segments->getSegmentCount() : 0;
+    header.solverMode = resolver.getMode();
+    header.iterations = resolver.getIterations();
+    header.calculateIterations = calculateIterations ? 1 : 0;
+    header.velocitySweeps = resolver.getVelocitySweeps();
+    header.positionSweeps = resolver.getPositionSweeps();
+    header.velocityTolerance = resolver.getVelocityTolerance();
+    header.positionTolerance = resolver.getPositionTolerance();
+    header.maxCorrection = resolver.getMaxCorrection();
+    header.compliance = resolver.getCompliance();
+    header.contactLimit = contactLimit;
+    header.sleepFrames = sleepFrames;
+    header.sleepEnergy = sleepEnergy;
+    header.integrationPath = store.getIntegrationPath();
+    header.contactCaching = contactCaching ? 1 : 0;
+
+    // Lay the sections out one after another, each aligned.
+    uint64_t offset = alignCheckpointOffset(sizeof(CheckpointHeader));
+    for (unsigned c = 0; c < CHECKPOINT_COLUMNS; c++)
+    {
+        header.columnOffset[c] = offset;
+        if (c == CHECKPOINT_AWAKE_COLUMN) offset += count;
+        else if (c == CHECKPOINT_REST_COLUMN || c == CHECKPOINT_ISLAND_COLUMN) offset += (uint64_t)count * sizeof(uint32_t);
+        else offset += (uint64_t)count * sizeof(float);
+        offset = alignCheckpointOffset(offset);
+    }
+    header.segmentOffset = offset;
+    header.fileSize = offset + (uint64_t)header.segmentCount * sizeof(CheckpointSegment);
+
+    // Rest frames and islands are only kept while sleeping is on. Particles
+    // without them haven't rested, and are in islands of their own.
+    std::vector<uint32_t> rest(count, 0);
+    std::vector<uint32_t> islands(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (i < restFrames.size()) rest[i] = restFrames[i];
+        islands[i] = i < islandId.size() ? islandId[i] : i;
+    }
+
+    std::vector<CheckpointSegment> segmentRecords(header.segmentCount);
+    for (unsigned i = 0; i < header.segmentCount; i++)
+    {
+        const StaticSegments::Segment &segment = segments->getSegment(i);
+        segmentRecords[i].startX = segment.start.x;
+        segmentRecords[i].startY = segment.start.y;
+        segmentRecords[i].endX = segment.end.x;
+        segmentRecords[i].endY = segment.end.y;
+        segmentRecords[i].restitution = segment.restitution;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+
+    uint64_t position = 0;
+    bool written = writeSection(file, position, 0, &header, sizeof(header));
+    for (unsigned c = 0; written && c < CHECKPOINT_COLUMNS; c++)
+    {
+        if (count == 0) break;
+        if (c == CHECKPOINT_AWAKE_COLUMN) written = writeSection(file, position, header.columnOffset[c], &store.awake[0], count);
+        else if (c == CHECKPOINT_REST_COLUMN) written = writeSection(file, position, header.columnOffset[c], &rest[0], count * sizeof(uint32_t));
+        else if (c == CHECKPOINT_ISLAND_COLUMN) written = writeSection(file, position, header.columnOffset[c], &islands[0], count * sizeof(uint32_t));
+        else written = writeSection(file, position, header.columnOffset[c], &(store.*checkpointFloatColumns[c])[0], count * sizeof(float));
+    }
+    if (written) written = writeSection(file, position, header.segmentOffset,
+        segmentRecords.empty() ? 0 : &segmentRecords[0], segmentRecords.size() * sizeof(CheckpointSegment));
+
+    if (fclose(file) != 0) written = false;
+    return written;
+}
+
+bool ParticleWorld::loadCheckpoint(const char *path, StaticSegments *segments)
+{
+    CheckpointView view;
+    if (!view.open(path)) return false;
+
+    const CheckpointHeader &header = view.getHeader();
+    unsigned count = header.particleCount;
+    if (count < store.size()) return false;
+
+    // Make room for every particle, then copy each column across whole.
+    if (count > store.size()) createParticles(count - store.size());
+
+    if (count > 0)
+    {
+        for (unsigned c = 0; c < CHECKPOINT_FLOAT_COLUMNS; c++)
+        {
+            memcpy(&(store.*checkpointFloatColumns[c])[0], view.getFloatColumn(c), count * sizeof(float));
+        }
+        memcpy(&store.awake[0], view.getAwake(), count);
+    }
+
+    // Rest frames and islands are only kept while sleeping is on, as in
+    // getChecksum.
+    const uint32_t *rest = view.getRestFrames();
+    const uint32_t *islands = view.getIslands();
+    if (header.sleepEnergy > 0)
+    {
+        restFrames.assign(rest, rest + count);
+        islandId.assign(islands, islands + count);
+    }
+    else
+    {
+        restFrames.clear();
+        islandId.clear();
+    }
+
+    awakeCount = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (store.awake[i]) awakeCount++;
+    }
+
+    resolver.setMode((ParticleContactResolver::SolverMode)header.solverMode);
+    resolver.setIterations(header.iterations);
+    resolver.setSweeps(header.velocitySweeps, header.positionSweeps);
+    resolver.setTolerance(header.velocityTolerance, header.positionTolerance);
+    resolver.setMaxCorrection(header.maxCorrection);
+    resolver.setCompliance(header.compliance);
+    calculateIterations = header.calculateIterations != 0;
+    contactLimit = header.contactLimit;
+    sleepEnergy = header.sleepEnergy;
+    sleepFrames = header.sleepFrames;
+    store.setIntegrationPath((ParticleStore::IntegrationPath)header.integrationPath);
+
+    // The cached impulses belong to the state being replaced, so this
+    // starts the cache empty.
+    setContactCaching(header.contactCaching != 0);
+
+    if (segments)
+    {
+        segments->clear();
+        const CheckpointSegment *records = view.getSegments();
+        for (unsigned i = 0; i < header.segmentCount; i++)
+        {
+            segments->addSegment(Vector2(records[i].startX, records[i].startY),
+                Vector2(records[i].endX, records[i].endY), records[i].restitution);
+        }
+    }
+
+    return true;
+}
+
+// Folds a block of bytes in to a 64 bit FNV-1a hash, a word at a time.
+static unsigned long long hashBytes(unsigned long long hash, const void *data, size_t bytes)
+{
+    const unsigned long long prime = 0x100000001b3ull;
+    const unsigned char *bytePointer = (const unsigned char*)data;
+
+    size_t words = bytes / 8;
+    for (size_t w = 0; w < words; w++)
+    {
+        unsigned long long word;
+        memcpy(&word, bytePointer + w * 8, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (size_t b = words * 8; b < bytes; b++)
+    {
+        hash = (hash ^ bytePointer[b]) * prime;
+    }
+    return hash;
+}
+
+unsigned long long ParticleWorld::getChecksum() const
+{
+    unsigned count = store.size();
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    hash = hashBytes(hash, &count, sizeof(count));
+    if (count == 0) return hash;
+
+    for (unsigned c = 0; c < CHECKPOINT_FLOAT_COLUMNS; c++)
+    {
+        hash = hashBytes(hash, &(store.*checkpointFloatColumns[c])[0], count * sizeof(float));
+    }
+    hash = hashBytes(hash, &store.awake[0], count);
+
+    // Rest frames and islands count only while sleeping is on, and as a
+    // checkpoint holds them: one per particle, with no rest and an island of
+    // its own for any the world hasn't stepped yet.
+    if (sleepEnergy > 0)
+    {
+        if (restFrames.size() == count && islandId.size() == count)
+        {
+            hash = hashBytes(hash, &restFrames[0], count * sizeof(unsigned));
+            hash = hashBytes(hash, &islandId[0], count * sizeof(unsigned));
+        }
+        else
+        {
+            std::vector<unsigned> rest(count, 0);
+            std::vector<unsigned> islands(count);
+            for (unsigned i = 0; i < count; i++)
+            {
+                if (i < restFrames.size()) rest[i] = restFrames[i];
+                islands[i] = i < islandId.size() ? islandId[i] : i;
+            }
+            hash = hashBytes(hash, &rest[0], count * sizeof(unsigned));
+            hash = hashBytes(hash, &islands[0], count * sizeof(unsigned));
+        }
+    }
+    return hash;
+}
+
+ParticleContactResolver& ParticleWorld::getResolver()
+{
+    return resolver;
+}
+
+ParticleStore& ParticleWorld::getStore()
+{
+    return store;
+}
+
 ParticleWorld::ContactGenerators& ParticleWorld::getContactGenerators()
 {
     return contactGenerators;
 }
+
+ParticleForceRegistry& ParticleWorld::getForceRegistry()
+{
+    return registry;
+}
@@ -0,0 +1,447 @@
+#include <recorder.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+static const uint32_t trajectoryVersion = 1;
+
+// Encoded frames are gathered until there is this much to write.
+static const size_t writeChunkSize = 1 << 20;
+
+static bool seekTo(FILE *file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// Returns the size of an open file, leaving its position at the end.
+static uint64_t fileSize(FILE *file)
+{
+#ifdef _WIN32
+	if (_fseeki64(file, 0, SEEK_END) != 0) return 0;
+	__int64 size = _ftelli64(file);
+#else
+	if (fseeko(file, 0, SEEK_END) != 0) return 0;
+	off_t size = ftello(file);
+#endif
+	return size > 0 ? (uint64_t)size : 0;
+}
+
+// Rounds a value to the nearest multiple of quantum, clamped to 32 bits.
+static int32_t quantise(float value, float quantum)
+{
+	double scaled = (double)value / quantum;
+	if (!(scaled > -2147483647.0)) return value > 0 ? 2147483647 : -2147483647;
+	if (scaled > 2147483647.0) return 2147483647;
+	return (int32_t)floor(scaled + 0.5);
+}
+
+static void writeVarint(std::vector<unsigned char> &buffer, uint32_t value)
+{
+	while (value >= 0x80){
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back((unsigned char)value);
+}
+
+// Reads a varint, returning false if it runs past the end.
+static bool readVarint(const unsigned char *&data, const unsigned char *end, uint32_t &value)
+{
+	value = 0;
+	for (unsigned shift = 0; shift < 35; shift += 7){
+		if (data == end) return false;
+		unsigned char byte = *data++;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+void TrajectoryFrame::resize(unsigned count)
+{
+	for (unsigned c = 0; c < columnCount; c++) getColumn(c).resize(count);
+}
+
+std::vector<float>& TrajectoryFrame::getColumn(unsigned column)
+{
+	switch (column){
+	case 0: return positionX;
+	case 1: return positionY;
+	case 2: return velocityX;
+	case 3: return velocityY;
+	default: return orientation;
+	}
+}
+
+const std::vector<float>& TrajectoryFrame::getColumn(unsigned column) const
+{
+	return const_cast<TrajectoryFrame*>(this)->getColumn(column);
+}
+
+TrajectoryRecorder::TrajectoryRecorder(unsigned ringFrames)
+:
+file(0),
+particleCount(0),
+keyframeInterval(1),
+ring(ringFrames > 0 ? ringFrames : 1),
+head(0),
+tail(0),
+closing(false),
+writeOffset(0),
+writeFailed(false),
+recordedFrames(0),
+droppedFrames(0)
+{
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	close();
+}
+
+bool TrajectoryRecorder::open(const char *path, unsigned particleCount,
+	float positionQuantum, float velocityQuantum, float orientationQuantum,
+	unsigned keyframeInterval)
+{
+	close();
+
+	file = fopen(path, "wb");
+	if (!file) return false;
+
+	TrajectoryRecorder::particleCount = particleCount;
+	TrajectoryRecorder::keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+	quanta[0] = positionQuantum;
+	quanta[1] = positionQuantum;
+	quanta[2] = velocityQuantum;
+	quanta[3] = velocityQuantum;
+	quanta[4] = orientationQuantum;
+
+	TrajectoryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "PWTRAJ01", 8);
+	header.version = trajectoryVersion;
+	header.byteOrder = 0x01020304;
+	header.particleCount = particleCount;
+	header.keyframeInterval = TrajectoryRecorder::keyframeInterval;
+	memcpy(header.quanta, quanta, sizeof(quanta));
+
+	// Allocate everything up front so recording never does.
+	for (unsigned f = 0; f < ring.size(); f++) ring[f].resize(particleCount);
+	previous.assign(particleCount * TrajectoryFrame::columnCount, 0);
+	writeBuffer.clear();
+	writeBuffer.reserve(writeChunkSize + particleCount * TrajectoryFrame::columnCount * 5);
+	writeBuffer.insert(writeBuffer.end(), (const unsigned char*)&header, (const unsigned char*)(&header + 1));
+	writeOffset = 0;
+	writeFailed = false;
+	index.clear();
+
+	head = 0;
+	tail = 0;
+	recordedFrames = 0;
+	droppedFrames = 0;
+	closing = false;
+	thread = std::thread(&TrajectoryRecorder::run, this);
+	return true;
+}
+
+bool TrajectoryRecorder::record(const ParticleStore &store, unsigned long step)
+{
+	if (!file || store.size() != particleCount) return false;
+
+	unsigned back = tail.load(std::memory_order_relaxed);
+	if (back - head.load(std::memory_order_acquire) >= ring.size()){
+		droppedFrames++;
+		return false;
+	}
+
+	TrajectoryFrame &frame = ring[back % ring.size()];
+	std::copy(store.positionX.begin(), store.positionX.end(), frame.positionX.begin());
+	std::copy(store.positionY.begin(), store.positionY.end(), frame.positionY.begin());
+	std::copy(store.velocityX.begin(), store.velocityX.end(), frame.velocityX.begin());
+	std::copy(store.velocityY.begin(), store.velocityY.end(), frame.velocityY.begin());
+	std::copy(store.orientation.begin(), store.orientation.end(), frame.orientation.begin());
+	frame.step = step;
+
+	tail.store(back + 1, std::memory_order_release);
+	frameReady.notify_one();
+	return true;
+}
+
+bool TrajectoryRecorder::close()
+{
+	if (!file) return true;
+
+	closing = true;
+	frameReady.notify_one();
+	thread.join();
+
+	// The thread has encoded everything queued; add the index and footer.
+	TrajectoryFooter footer;
+	memset(&footer, 0, sizeof(footer));
+	footer.indexOffset = writeOffset + writeBuffer.size();
+	footer.frameCount = (uint32_t)index.size();
+	memcpy(footer.magic, "PWTRAJIX", 8);
+
+	if (!index.empty()){
+		const unsigned char *entries = (const unsigned char*)&index[0];
+		writeBuffer.insert(writeBuffer.end(), entries, entries + index.size() * sizeof(TrajectoryIndexEntry));
+	}
+	writeBuffer.insert(writeBuffer.end(), (const unsigned char*)&footer, (const unsigned char*)(&footer + 1));
+	flush();
+
+	if (fclose(file) != 0) writeFailed = true;
+	file = 0;
+	return !writeFailed;
+}
+
+bool TrajectoryRecorder::isOpen() const
+{
+	return file != 0;
+}
+
+unsigned TrajectoryRecorder::getRecordedFrames() const
+{
+	return recordedFrames;
+}
+
+unsigned TrajectoryRecorder::getDroppedFrames() const
+{
+	return droppedFrames;
+}
+
+void TrajectoryRecorder::run()
+{
+	for (;;)
+	{
+		// Read closing before tail, so a frame queued just before closing is
+		// still seen.
+		bool finishing = closing;
+		unsigned front = head.load(std::memory_order_relaxed);
+
+		if (front == tail.load(std::memory_order_acquire))
+		{
+			if (finishing) break;
+
+			// record() notifies without taking the lock, so a wakeup can be
+			// missed; the timeout bounds how long that delays the frame.
+			std::unique_lock<std::mutex> lock(mutex);
+			frameReady.wait_for(lock, std::chrono::milliseconds(2));
+			continue;
+		}
+
+		encodeFrame(ring[front % ring.size()]);
+		head.store(front + 1, std::memory_order_release);
+	}
+}
+
+void TrajectoryRecorder::encodeFrame(const TrajectoryFrame &frame)
+{
+	TrajectoryIndexEntry entry;
+	entry.offset = writeOffset + writeBuffer.size();
+	entry.keyframe = (index.size() % keyframeInterval) == 0;
+	entry.step = frame.step;
+
+	if (entry.keyframe) std::fill(previous.begin(), previous.end(), 0);
+
+	for (unsigned c = 0; c < TrajectoryFrame::columnCount; c++){
+		const std::vector<float> &column = frame.getColumn(c);
+		int32_t *last = &previous[c * particleCount];
+
+		for (unsigned i = 0; i < particleCount; i++){
+			int32_t value = quantise(column[i], quanta[c]);
+
+			// Differences wrap around in 32 bits, which the reader undoes.
+			int32_t delta = (int32_t)((uint32_t)value - (uint32_t)last[i]);
+			last[i] = value;
+
+			writeVarint(writeBuffer, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+		}
+	}
+
+	entry.size = (uint32_t)(writeOffset + writeBuffer.size() - entry.offset);
+	index.push_back(entry);
+	recordedFrames++;
+
+	if (writeBuffer.size() >= writeChunkSize) flush();
+}
+
+void TrajectoryRecorder::flush()
+{
+	if (writeBuffer.empty()) return;
+
+	if (!writeFailed && fwrite(&writeBuffer[0], 1, writeBuffer.size(), file) != writeBuffer.size()){
+		writeFailed = true;
+	}
+	writeOffset += writeBuffer.size();
+	writeBuffer.clear();
+}
+
+TrajectoryReader::TrajectoryReader()
+:
+file(0),
+particleCount(0),
+current(-1)
+{
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+	close();
+}
+
+bool TrajectoryReader::open(const char *path)
+{
+	close();
+
+	file = fopen(path, "rb");
+	if (!file) return false;
+
+	uint64_t size = fileSize(file);
+	TrajectoryHeader header;
+	TrajectoryFooter footer;
+	bool valid =
+		size >= sizeof(header) + sizeof(footer) &&
+		seekTo(file, 0) &&
+		fread(&header, sizeof(header), 1, file) == 1 &&
+		seekTo(file, size - sizeof(footer)) &&
+		fread(&footer, sizeof(footer), 1, file) == 1 &&
+		validate(header, footer, size);
+
+	// Only read the index once it is known to fit in the file.
+	if (valid){
+		index.resize(footer.frameCount);
+		valid = seekTo(file, footer.indexOffset) &&
+			(index.empty() || fread(&index[0], sizeof(TrajectoryIndexEntry), index.size(), file) == index.size());
+	}
+	for (size_t f = 0; valid && f < index.size(); f++){
+		valid = validate(index[f], header, footer);
+	}
+	if (valid && !index.empty()){
+		valid = index[0].keyframe != 0;
+	}
+	if (!valid){
+		close();
+		return false;
+	}
+
+	particleCount = header.particleCount;
+	memcpy(quanta, header.quanta, sizeof(quanta));
+	values.assign(index.empty() ? 0 : (size_t)particleCount * TrajectoryFrame::columnCount, 0);
+	current = -1;
+	return true;
+}
+
+bool TrajectoryReader::validate(const TrajectoryHeader &header, const TrajectoryFooter &footer, uint64_t size) const
+{
+	if (memcmp(header.magic, "PWTRAJ01", 8) != 0) return false;
+	if (header.version != trajectoryVersion) return false;
+	if (header.byteOrder != 0x01020304) return false;
+	if (memcmp(footer.magic, "PWTRAJIX", 8) != 0) return false;
+
+	// The index runs from its offset right up to the footer.
+	uint64_t indexEnd = size - sizeof(TrajectoryFooter);
+	if (footer.indexOffset < sizeof(TrajectoryHeader) || footer.indexOffset > indexEnd) return false;
+	if ((uint64_t)footer.frameCount * sizeof(TrajectoryIndexEntry) != indexEnd - footer.indexOffset) return false;
+
+	// Every value of every frame takes at least a byte, so the particles
+	// must fit in the frames that hold them.
+	if (footer.frameCount > 0 &&
+		(uint64_t)header.particleCount * TrajectoryFrame::columnCount > footer.indexOffset) return false;
+
+	return true;
+}
+
+bool TrajectoryReader::validate(const TrajectoryIndexEntry &entry, const TrajectoryHeader &header, const TrajectoryFooter &footer) const
+{
+	// A frame lies between the header and the index, and holds one varint of
+	// one to five bytes per value.
+	uint64_t values = (uint64_t)header.particleCount * TrajectoryFrame::columnCount;
+	if (entry.offset < sizeof(TrajectoryHeader) || entry.offset > footer.indexOffset) return false;
+	if (entry.size > footer.indexOffset - entry.offset) return false;
+	if (entry.size < values || entry.size > values * 5) return false;
+
+	return true;
+}
+
+void TrajectoryReader::close()
+{
+	if (file) fclose(file);
+	file = 0;
+	particleCount = 0;
+	index.clear();
+	current = -1;
+}
+
+unsigned TrajectoryReader::getParticleCount() const
+{
+	return particleCount;
+}
+
+unsigned TrajectoryReader::getFrameCount() const
+{
+	return (unsigned)index.size();
+}
+
+unsigned long TrajectoryReader::getStep(unsigned frame) const
+{
+	return (unsigned long)index[frame].step;
+}
+
+float TrajectoryReader::getQuantum(unsigned column) const
+{
+	return quanta[column];
+}
+
+bool TrajectoryReader::readFrame(unsigned frame, TrajectoryFrame &result)
+{
+	if (!file || frame >= index.size()) return false;
+
+	// Carry on from the frame already decoded if no keyframe lies between.
+	unsigned start = frame;
+	while (!index[start].keyframe) start--;
+	if (current >= (int)start && current <= (int)frame) start = current + 1;
+
+	for (unsigned f = start; f <= frame; f++){
+		if (!decodeFrame(f)){
+			current = -1;
+			return false;
+		}
+		current = (int)f;
+	}
+
+	result.resize(particleCount);
+	result.step = (unsigned long)index[frame].step;
+	for (unsigned c = 0; c < TrajectoryFrame::columnCount; c++){
+		std::vector<float> &column = result.getColumn(c);
+		const int32_t *source = &values[c * particleCount];
+		for (unsigned i = 0; i < particleCount; i++) column[i] = source[i] * quanta[c];
+	}
+	return true;
+}
+
+bool TrajectoryReader::decodeFrame(unsigned frame)
+{
+	const TrajectoryIndexEntry &entry = index[frame];
+
+	readBuffer.resize(entry.size);
+	if (!seekTo(file, entry.offset)) return false;
+	if (entry.size > 0 && fread(&readBuffer[0], 1, entry.size, file) != entry.size) return false;
+
+	if (entry.keyframe) std::fill(values.begin(), values.end(), 0);
+
+	const unsigned char *data = readBuffer.empty() ? 0 : &readBuffer[0];
+	const unsigned char *end = data + readBuffer.size();
+	for (size_t v = 0; v < values.size(); v++){
+		uint32_t encoded;
+		if (!readVarint(data, end, encoded)) return false;
+
+		uint32_t delta = (encoded >> 1) ^ (0u - (encoded & 1));
+		values[v] = (int32_t)((uint32_t)values[v] + delta);
+	}
+	return data == end;
+}
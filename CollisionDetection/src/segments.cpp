@@ -0,0 +1,233 @@
+#include <segments.h>
+#include <platform.h>
+#include <plog.h>
+#include <algorithm>
+#include <math.h>
+
+// Segments per leaf of the hierarchy.
+static const unsigned leafSize = 4;
+
+// Orders segments by the centre of their bounding boxes along one axis.
+struct SegmentCentreLess
+{
+	unsigned axis;
+
+	bool operator()(const StaticSegments::Segment &a, const StaticSegments::Segment &b) const
+	{
+		return (a.min[axis] + a.max[axis]) < (b.min[axis] + b.max[axis]);
+	}
+};
+
+StaticSegments::StaticSegments()
+:
+built(false),
+particles(0)
+{
+}
+
+StaticSegments::~StaticSegments() {
+
+}
+
+void StaticSegments::addSegment(const Vector2 &start, const Vector2 &end, float restitution)
+{
+	Segment segment;
+	segment.start = start;
+	segment.end = end;
+	segment.direction = end - start;
+
+	float squareLength = segment.direction.squareMagnitude();
+	segment.inverseSquareLength = (squareLength > 0) ? 1.0f / squareLength : 0.0f;
+
+	segment.min = Vector2(start.x < end.x ? start.x : end.x, start.y < end.y ? start.y : end.y);
+	segment.max = Vector2(start.x > end.x ? start.x : end.x, start.y > end.y ? start.y : end.y);
+	segment.restitution = restitution;
+
+	added.push_back(segment);
+	built = false;
+}
+
+void StaticSegments::addPlatforms(const Platform *platforms, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++){
+		addSegment(platforms[i].start, platforms[i].end);
+	}
+}
+
+void StaticSegments::clear()
+{
+	added.clear();
+	segments.clear();
+	nodes.clear();
+	built = false;
+}
+
+unsigned StaticSegments::getSegmentCount() const
+{
+	return (unsigned)added.size();
+}
+
+const StaticSegments::Segment& StaticSegments::getSegment(unsigned index) const
+{
+	return added[index];
+}
+
+void StaticSegments::setParticles(const std::vector<Particle*> *particles)
+{
+	StaticSegments::particles = particles;
+}
+
+void StaticSegments::build() const
+{
+	segments = added;
+	nodes.clear();
+	if (!segments.empty()){
+		// A binary tree with leaves of up to leafSize segments has fewer than
+		// 2 * segments / leafSize + 1 nodes, reserve so building doesn't reallocate.
+		nodes.reserve(2 * segments.size() / leafSize + 2);
+		nodes.push_back(Node());
+		buildNode(0, 0, (unsigned)segments.size());
+	}
+	built = true;
+}
+
+void StaticSegments::buildNode(unsigned node, unsigned first, unsigned count) const
+{
+	// Bound the segments, and the centres of the segments to choose a split.
+	Vector2 min = segments[first].min;
+	Vector2 max = segments[first].max;
+	Vector2 centreMin = (segments[first].min + segments[first].max) * 0.5f;
+	Vector2 centreMax = centreMin;
+
+	for (unsigned i = first + 1; i < first + count; i++){
+		const Segment &segment = segments[i];
+		Vector2 centre = (segment.min + segment.max) * 0.5f;
+
+		if (segment.min.x < min.x) min.x = segment.min.x;
+		if (segment.min.y < min.y) min.y = segment.min.y;
+		if (segment.max.x > max.x) max.x = segment.max.x;
+		if (segment.max.y > max.y) max.y = segment.max.y;
+
+		if (centre.x < centreMin.x) centreMin.x = centre.x;
+		if (centre.y < centreMin.y) centreMin.y = centre.y;
+		if (centre.x > centreMax.x) centreMax.x = centre.x;
+		if (centre.y > centreMax.y) centreMax.y = centre.y;
+	}
+
+	nodes[node].min = min;
+	nodes[node].max = max;
+
+	if (count <= leafSize){
+		nodes[node].first = first;
+		nodes[node].count = count;
+		return;
+	}
+
+	// Split at the median centre along the axis the centres spread furthest.
+	SegmentCentreLess less;
+	less.axis = (centreMax.x - centreMin.x >= centreMax.y - centreMin.y) ? 0 : 1;
+
+	unsigned half = count / 2;
+	std::nth_element(segments.begin() + first, segments.begin() + first + half,
+		segments.begin() + first + count, less);
+
+	unsigned children = (unsigned)nodes.size();
+	nodes[node].first = children;
+	nodes[node].count = 0;
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+
+	buildNode(children, first, half);
+	buildNode(children + 1, first + half, count - half);
+}
+
+bool StaticSegments::testSegment(Particle *particle, const Segment &segment, ParticleContact *contact) const
+{
+	Vector2 position = particle->getPosition();
+	float radius = particle->getRadius();
+	float squareRadius = radius * radius;
+
+	// Get distance to particle from start point, and how far along the segment
+	// it is (as a fraction of the segment's length).
+	Vector2 toParticle = position - segment.start;
+	float along = (toParticle * segment.direction) * segment.inverseSquareLength;
+
+	Vector2 closestPoint;
+	if (along <= 0){
+		// The particle is nearest to the start point.
+		closestPoint = segment.start;
+	}
+	else if (along >= 1){
+		// The particle is nearest to the end point.
+		closestPoint = segment.end;
+	}
+	else {
+		// The particle is between the start and end points.
+		closestPoint = segment.start + segment.direction * along;
+	}
+
+	Vector2 toClosest = position - closestPoint;
+	float squareDistance = toClosest.squareMagnitude();
+	if (squareDistance >= squareRadius) return false;
+
+	float distance = sqrtf(squareDistance);
+
+	// A particle centred exactly on the segment has no meaningful normal, push it up.
+	contact->contactNormal = (distance > 0) ? toClosest * (1.0f / distance) : Vector2(0, 1);
+	contact->restitution = segment.restitution;
+	contact->particle[0] = particle;
+	contact->particle[1] = 0;
+	contact->penetration = radius - distance;
+	contact->contactPoint = closestPoint;
+	return true;
+}
+
+unsigned StaticSegments::addContact(ParticleContact *contact, unsigned limit) const
+{
+	if (!built) build();
+	if (!particles || nodes.empty()) return 0;
+
+	unsigned used = 0;
+
+	// Median splits keep the tree balanced, so its depth is well under this.
+	unsigned stack[64];
+
+	for (std::vector<Particle*>::const_iterator p = particles->begin(); p != particles->end(); p++){
+		// Sleeping particles haven't moved since they last rested here.
+		if (!(*p)->isAwake()) continue;
+
+		Vector2 position = (*p)->getPosition();
+		float radius = (*p)->getRadius();
+		Vector2 min(position.x - radius, position.y - radius);
+		Vector2 max(position.x + radius, position.y + radius);
+
+		unsigned depth = 0;
+		stack[depth++] = 0;
+		while (depth > 0){
+			const Node &node = nodes[stack[--depth]];
+			if (node.max.x < min.x || node.min.x > max.x || node.max.y < min.y || node.min.y > max.y) continue;
+
+			if (node.count == 0){
+				stack[depth++] = node.first;
+				stack[depth++] = node.first + 1;
+				continue;
+			}
+
+			for (unsigned s = node.first; s < node.first + node.count; s++){
+				const Segment &segment = segments[s];
+				if (segment.max.x < min.x || segment.min.x > max.x || segment.max.y < min.y || segment.min.y > max.y) continue;
+
+				if (used >= limit){
+					PLOG_INFO(PhysicsLog::EVENT_CONTACT_LIMIT, "segments", used);
+					return used;
+				}
+				if (testSegment(*p, segment, contact)){
+					used++;
+					contact++;
+				}
+			}
+		}
+	}
+
+	return used;
+}
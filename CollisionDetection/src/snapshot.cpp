@@ -0,0 +1,47 @@
+#include <snapshot.h>
+
+float ParticleSnapshot::getInterpolation(Clock::time_point now) const
+{
+	if (stepDuration <= 0) return 1.0f;
+
+	float since = std::chrono::duration<float>(now - time).count();
+	float alpha = interpolation + since / stepDuration;
+	if (alpha < 0) return 0;
+	return alpha < 1.0f ? alpha : 1.0f;
+}
+
+SnapshotBuffer::SnapshotBuffer()
+:
+middle(1),
+back(0),
+front(2)
+{
+}
+
+ParticleSnapshot& SnapshotBuffer::getBack()
+{
+	return buffers[back];
+}
+
+void SnapshotBuffer::publish()
+{
+	// Release makes the writes to the back buffer visible to the reader that
+	// picks it up; acquire gets the reader's hand back of the old middle.
+	unsigned previous = middle.exchange(back | freshBit, std::memory_order_acq_rel);
+	back = previous & indexMask;
+}
+
+const ParticleSnapshot& SnapshotBuffer::acquire()
+{
+	if (middle.load(std::memory_order_relaxed) & freshBit)
+	{
+		unsigned previous = middle.exchange(front, std::memory_order_acq_rel);
+		front = previous & indexMask;
+	}
+	return buffers[front];
+}
+
+bool SnapshotBuffer::hasNewSnapshot() const
+{
+	return (middle.load(std::memory_order_relaxed) & freshBit) != 0;
+}
@@ -0,0 +1,95 @@
+#include <sweep.h>
+#include <narrowphase.h>
+
+
+SweepAndPrune::SweepAndPrune()
+:
+particles(0),
+restitution(1.0f)
+{
+}
+
+SweepAndPrune::~SweepAndPrune() {
+
+}
+
+void SweepAndPrune::setParticles(const std::vector<Particle*> *particles)
+{
+	SweepAndPrune::particles = particles;
+	entries.clear();
+}
+
+void SweepAndPrune::setRestitution(float restitution)
+{
+	SweepAndPrune::restitution = restitution;
+}
+
+void SweepAndPrune::rebuildEntries() const
+{
+	entries.resize(particles->size());
+	for (unsigned i = 0; i < entries.size(); i++){
+		entries[i].particle = (*particles)[i];
+	}
+}
+
+void SweepAndPrune::updateEntries() const
+{
+	// The particle list only ever changes when particles are created, so a
+	// change in size is enough to notice it.
+	if (entries.size() != particles->size()) rebuildEntries();
+
+	for (std::vector<Entry>::iterator e = entries.begin(); e != entries.end(); e++){
+		Vector2 position = e->particle->getPosition();
+		float radius = e->particle->getRadius();
+		e->minX = position.x - radius;
+		e->maxX = position.x + radius;
+		e->minY = position.y - radius;
+		e->maxY = position.y + radius;
+	}
+
+	/*
+		Insertion sort on minX.  The list is still sorted from the last frame
+		apart from the particles that passed a neighbour since, so each entry
+		usually moves at most a place or two.
+	*/
+	for (unsigned i = 1; i < entries.size(); i++){
+		if (entries[i - 1].minX <= entries[i].minX) continue;
+
+		Entry entry = entries[i];
+		unsigned j = i;
+		while (j > 0 && entries[j - 1].minX > entry.minX){
+			entries[j] = entries[j - 1];
+			j--;
+		}
+		entries[j] = entry;
+	}
+}
+
+unsigned SweepAndPrune::addContact(ParticleContact *contact, unsigned limit) const
+{
+	if (!particles) return 0;
+
+	updateEntries();
+
+	unsigned used = 0;
+	unsigned count = (unsigned)entries.size();
+
+	for (unsigned i = 0; i < count; i++){
+		const Entry &first = entries[i];
+
+		// Every later entry starts at or after this one; stop at the first
+		// that starts beyond its end.
+		for (unsigned j = i + 1; j < count && entries[j].minX <= first.maxX; j++){
+			const Entry &second = entries[j];
+			if (second.minY > first.maxY || second.maxY < first.minY) continue;
+
+			if (used >= limit) return used;
+			if (sphereContact(first.particle, second.particle, restitution, contact)){
+				used++;
+				contact++;
+			}
+		}
+	}
+
+	return used;
+}
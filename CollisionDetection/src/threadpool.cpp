@@ -0,0 +1,137 @@
+#include <threadpool.h>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+:
+jobGeneration(0),
+stopping(false),
+activeWorkers(0),
+task(0),
+count(0),
+grainSize(1),
+chunkCount(0),
+nextChunk(0),
+chunksDone(0)
+{
+	setThreadCount(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+	setThreadCount(1);
+}
+
+void ThreadPool::setThreadCount(unsigned threadCount)
+{
+	if (threadCount < 1) threadCount = 1;
+	if (threadCount == getThreadCount()) return;
+
+	// Stop all the current workers, then start the requested number.
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (std::vector<std::thread>::iterator w = workers.begin(); w != workers.end(); w++)
+	{
+		w->join();
+	}
+	workers.clear();
+	stopping = false;
+
+	// The calling thread is thread 0, so only threadCount - 1 workers are needed.
+	for (unsigned thread = 1; thread < threadCount; thread++)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, thread));
+	}
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+	return (unsigned)workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(unsigned count, unsigned grainSize, const Task &task)
+{
+	if (count == 0) return;
+	if (grainSize < 1) grainSize = 1;
+
+	unsigned chunks = (count + grainSize - 1) / grainSize;
+
+	// Nothing to share, run it here without touching the workers.
+	if (workers.empty() || chunks == 1)
+	{
+		for (unsigned begin = 0; begin < count; begin += grainSize)
+		{
+			unsigned end = (count - begin > grainSize) ? begin + grainSize : count;
+			task(begin, end, 0);
+		}
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		// A worker that woke late for the last job may still be on its way out.
+		while (activeWorkers > 0) jobDone.wait(lock);
+
+		ThreadPool::task = &task;
+		ThreadPool::count = count;
+		ThreadPool::grainSize = grainSize;
+		chunkCount = chunks;
+		nextChunk = 0;
+		chunksDone = 0;
+		jobGeneration++;
+	}
+	jobReady.notify_all();
+
+	// Help out rather than sit idle.
+	runChunks(0);
+
+	// Wait for every chunk, and for every worker to stop looking at the job,
+	// before the task goes out of scope.
+	std::unique_lock<std::mutex> lock(mutex);
+	while (chunksDone.load() < chunkCount || activeWorkers > 0) jobDone.wait(lock);
+	ThreadPool::task = 0;
+}
+
+void ThreadPool::workerLoop(unsigned thread)
+{
+	unsigned long lastGeneration = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		lastGeneration = jobGeneration;
+	}
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && jobGeneration == lastGeneration) jobReady.wait(lock);
+			if (stopping) return;
+			lastGeneration = jobGeneration;
+			activeWorkers++;
+		}
+
+		runChunks(thread);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		jobDone.notify_all();
+	}
+}
+
+void ThreadPool::runChunks(unsigned thread)
+{
+	for (;;)
+	{
+		unsigned chunk = nextChunk.fetch_add(1);
+		if (chunk >= chunkCount) return;
+
+		unsigned begin = chunk * grainSize;
+		unsigned end = (count - begin > grainSize) ? begin + grainSize : count;
+		(*task)(begin, end, thread);
+
+		chunksDone.fetch_add(1);
+	}
+}
@@ -0,0 +1,130 @@
+#include <timestep.h>
+
+FixedTimestep::FixedTimestep(ParticleWorld *world, float stepDuration, unsigned maxSubsteps)
+:
+world(world),
+stepDuration(stepDuration),
+maxSubsteps(maxSubsteps > 0 ? maxSubsteps : 1),
+accumulator(0),
+droppedTime(0)
+{
+}
+
+void FixedTimestep::setStepDuration(float stepDuration)
+{
+	FixedTimestep::stepDuration = stepDuration;
+}
+
+float FixedTimestep::getStepDuration() const
+{
+	return stepDuration;
+}
+
+void FixedTimestep::setMaxSubsteps(unsigned maxSubsteps)
+{
+	FixedTimestep::maxSubsteps = maxSubsteps > 0 ? maxSubsteps : 1;
+}
+
+unsigned FixedTimestep::getMaxSubsteps() const
+{
+	return maxSubsteps;
+}
+
+unsigned FixedTimestep::advance(float elapsed)
+{
+	if (elapsed > 0) accumulator += elapsed;
+	if (stepDuration <= 0) return 0;
+
+	// Count the whole steps by taking them off one at a time, as dividing
+	// can round down to one too few and leave a whole step behind.
+	unsigned steps = 0;
+	float remaining = accumulator;
+	while (remaining >= stepDuration && steps < maxSubsteps)
+	{
+		remaining -= stepDuration;
+		steps++;
+	}
+
+	// Don't try to catch up more than the limit, drop whatever is over.
+	if (remaining >= stepDuration)
+	{
+		droppedTime += remaining;
+		remaining = 0;
+	}
+
+	for (unsigned i = 0; i < steps; i++)
+	{
+		// Only the state before the last step is needed to interpolate.
+		if (i == steps - 1) savePreviousState();
+
+		world->runPhysics(stepDuration);
+	}
+	accumulator = remaining;
+
+	return steps;
+}
+
+float FixedTimestep::getInterpolation() const
+{
+	if (stepDuration <= 0) return 1.0f;
+	return accumulator / stepDuration;
+}
+
+Vector2 FixedTimestep::getPosition(unsigned index) const
+{
+	const ParticleStore &store = world->getStore();
+	Vector2 current(store.positionX[index], store.positionY[index]);
+
+	// Particles created since the last step have no previous state.
+	if (index >= previousX.size()) return current;
+
+	float alpha = getInterpolation();
+	Vector2 previous(previousX[index], previousY[index]);
+	return previous + (current - previous) * alpha;
+}
+
+float FixedTimestep::getOrientation(unsigned index) const
+{
+	const ParticleStore &store = world->getStore();
+	float current = store.orientation[index];
+
+	if (index >= previousOrientation.size()) return current;
+
+	float alpha = getInterpolation();
+	return previousOrientation[index] + (current - previousOrientation[index]) * alpha;
+}
+
+Vector2 FixedTimestep::getPreviousPosition(unsigned index) const
+{
+	const ParticleStore &store = world->getStore();
+	if (index >= previousX.size()) return Vector2(store.positionX[index], store.positionY[index]);
+	return Vector2(previousX[index], previousY[index]);
+}
+
+float FixedTimestep::getPreviousOrientation(unsigned index) const
+{
+	if (index >= previousOrientation.size()) return world->getStore().orientation[index];
+	return previousOrientation[index];
+}
+
+float FixedTimestep::getDroppedTime() const
+{
+	return droppedTime;
+}
+
+void FixedTimestep::reset()
+{
+	accumulator = 0;
+	droppedTime = 0;
+	previousX.clear();
+	previousY.clear();
+	previousOrientation.clear();
+}
+
+void FixedTimestep::savePreviousState()
+{
+	const ParticleStore &store = world->getStore();
+	previousX = store.positionX;
+	previousY = store.positionY;
+	previousOrientation = store.orientation;
+}